@@ -0,0 +1,391 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+#ifndef TSHELL_PATH
+#define TSHELL_PATH "./TShell"
+#endif
+namespace Origin {
+/* Drives TShell through a pseudo-terminal the way a user would and measures
+how quickly it responds: keystroke to echo, command to first output, bulk
+output throughput, a large bracketed paste, CPU use while idle and peak
+resident memory. Every latency is the time from writing to the master side to
+reading the byte that proves the shell reacted, so it includes the shell's
+frame pacing. Results are printed as one JSON object for regression
+tracking. */
+struct Bench {
+  /* What to run and how much of each workload to replay. */
+  struct Options {
+    std::string Bin{TSHELL_PATH};
+    std::string Out{};
+    int Samples{200};
+    long Bytes{64L << 20};
+    long PasteKb{32};
+    double IdleSeconds{3.0};
+    /* Seconds to wait for any one response before giving up. */
+    double Timeout{30.0};
+  };
+  /* Percentiles of a series of latencies in milliseconds. */
+  struct Summary {
+    size_t Count{0};
+    double Mean{0}, P50{0}, P95{0}, P99{0}, Max{0};
+  };
+
+private:
+  Options Opt;
+  int Fd{-1};
+  pid_t Pid{-1};
+  std::string HistFile;
+  /* Everything read from the terminal so far. */
+  std::string Out;
+
+  static auto Now() -> double {
+    return std::chrono::duration<double>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+  // Reads what the shell wrote, waiting at most 'timeout' milliseconds for
+  // it. Returns false once the terminal is closed.
+  auto Pump(int timeout) -> bool {
+    struct pollfd pfd {
+      Fd, POLLIN, 0
+    };
+    if (poll(&pfd, 1, timeout) <= 0) {
+      return true;
+    }
+    char buf[65536];
+    ssize_t const n = read(Fd, buf, sizeof(buf));
+    if (n <= 0) {
+      return n < 0 && errno == EINTR;
+    }
+    Out.append(buf, static_cast<size_t>(n));
+    return true;
+  }
+  // Reads until 'needle' appears at or after offset 'from'. Returns the
+  // seconds waited, or a negative value on timeout.
+  auto WaitFor(const std::string &needle, size_t from) -> double {
+    double const start = Now();
+    size_t scan = from;
+    while (Now() - start < Opt.Timeout) {
+      if (Out.find(needle, scan) != std::string::npos) {
+        return Now() - start;
+      }
+      // Keep enough of the tail to find a needle split across reads.
+      scan = std::max(from, (Out.size() > needle.size())
+                                ? Out.size() - needle.size()
+                                : size_t(0));
+      if (!Pump(100)) {
+        break;
+      }
+    }
+    return (Out.find(needle, scan) != std::string::npos) ? Now() - start : -1;
+  }
+  // Reads until the shell has been silent for 'quiet' seconds.
+  auto Settle(double quiet) -> void {
+    size_t size = Out.size();
+    double last = Now();
+    while (Now() - last < quiet) {
+      if (!Pump(20)) {
+        return;
+      }
+      if (Out.size() != size) {
+        size = Out.size();
+        last = Now();
+      }
+    }
+  }
+  auto Send(const std::string &text) -> void {
+    for (size_t done = 0; done < text.size();) {
+      ssize_t const n = write(Fd, text.data() + done, text.size() - done);
+      if (n > 0) {
+        done += static_cast<size_t>(n);
+      } else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+        return;
+      } else {
+        // The terminal's input queue is full until the shell reads it.
+        Pump(10);
+      }
+    }
+  }
+  // Returns the CPU seconds the shell has used, user and system.
+  auto Cpu() const -> double {
+    FILE *f = fopen(("/proc/" + std::to_string(Pid) + "/stat").c_str(), "r");
+    if (f == nullptr) {
+      return 0;
+    }
+    char buf[1024];
+    size_t const n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+    // The command name may hold spaces, so fields are counted from its end.
+    const char *p = strrchr(buf, ')');
+    unsigned long utime = 0, stime = 0;
+    if (p == nullptr ||
+        sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+               &utime, &stime) != 2) {
+      return 0;
+    }
+    return static_cast<double>(utime + stime) /
+           static_cast<double>(sysconf(_SC_CLK_TCK));
+  }
+  // Returns the shell's peak resident set size in kilobytes.
+  auto PeakRss() const -> long {
+    FILE *f =
+        fopen(("/proc/" + std::to_string(Pid) + "/status").c_str(), "r");
+    if (f == nullptr) {
+      return 0;
+    }
+    char line[256];
+    long kb = 0;
+    while (fgets(line, sizeof(line), f) != nullptr) {
+      if (strncmp(line, "VmHWM:", 6) == 0) {
+        kb = atol(line + 6);
+      }
+    }
+    fclose(f);
+    return kb;
+  }
+  static auto Summarize(std::vector<double> samples) -> Summary {
+    Summary s;
+    s.Count = samples.size();
+    if (samples.empty()) {
+      return s;
+    }
+    std::sort(samples.begin(), samples.end());
+    auto const at = [&samples](double q) {
+      return samples[std::min(samples.size() - 1,
+                              static_cast<size_t>(q * samples.size()))];
+    };
+    double sum = 0;
+    for (double const v : samples) {
+      sum += v;
+    }
+    s.Mean = sum / static_cast<double>(samples.size());
+    s.P50 = at(0.50);
+    s.P95 = at(0.95);
+    s.P99 = at(0.99);
+    s.Max = samples.back();
+    return s;
+  }
+  static auto Json(const char *name, const Summary &s) -> std::string {
+    char buf[256];
+    snprintf(buf, sizeof(buf),
+             "\"%s\":{\"count\":%zu,\"mean_ms\":%.3f,\"p50_ms\":%.3f,"
+             "\"p95_ms\":%.3f,\"p99_ms\":%.3f,\"max_ms\":%.3f}",
+             name, s.Count, s.Mean, s.P50, s.P95, s.P99, s.Max);
+    return buf;
+  }
+
+public:
+  Bench(Options opt) : Opt(std::move(opt)) {}
+  ~Bench() { Stop(); }
+  Bench(const Bench &) = delete;
+  auto operator=(const Bench &) -> Bench & = delete;
+  // Starts the shell on an 80x25 terminal with a history file of its own and
+  // no run limit, and waits for its first frame.
+  auto Start() -> bool {
+    char path[] = "/tmp/tshell_bench_XXXXXX";
+    int const tmp = mkstemp(path);
+    if (tmp != -1) {
+      close(tmp);
+      HistFile = path;
+    }
+    struct winsize ws {};
+    ws.ws_row = 25;
+    ws.ws_col = 80;
+    Pid = forkpty(&Fd, nullptr, nullptr, &ws);
+    if (Pid == -1) {
+      return false;
+    }
+    if (Pid == 0) {
+      setenv("TSHELL_HISTORY", HistFile.c_str(), 1);
+      setenv("TSHELL_RUNTIME", "0", 1);
+      execl(Opt.Bin.c_str(), Opt.Bin.c_str(), static_cast<char *>(nullptr));
+      _exit(127);
+    }
+    fcntl(Fd, F_SETFL, fcntl(Fd, F_GETFL) | O_NONBLOCK);
+    if (WaitFor("$ ", 0) < 0) {
+      return false;
+    }
+    Settle(0.3);
+    return true;
+  }
+  // Asks the shell to exit, killing it if it does not, and removes the
+  // history file.
+  auto Stop() -> void {
+    if (Pid > 0) {
+      Send("\025exit\r");
+      double const start = Now();
+      int status = 0;
+      while (waitpid(Pid, &status, WNOHANG) == 0) {
+        if (Now() - start > 2.0) {
+          kill(Pid, SIGKILL);
+          waitpid(Pid, &status, 0);
+          break;
+        }
+        Pump(20);
+      }
+      Pid = -1;
+    }
+    if (Fd != -1) {
+      close(Fd);
+      Fd = -1;
+    }
+    if (!HistFile.empty()) {
+      unlink(HistFile.c_str());
+      HistFile.clear();
+    }
+  }
+  // Types one letter at a time and times each until the shell echoes it
+  // back, clearing the line every so often.
+  auto Keystrokes() -> std::vector<double> {
+    std::vector<double> ms;
+    for (int i = 0; i < Opt.Samples; i++) {
+      if (i % 26 == 0) {
+        Send("\025");
+        Settle(0.05);
+      }
+      std::string const key(1, static_cast<char>('a' + i % 26));
+      size_t const from = Out.size();
+      Send(key);
+      // The line is redrawn from the new letter on, ended by ']'.
+      double const t = WaitFor(key + "]", from);
+      if (t >= 0) {
+        ms.push_back(t * 1000.0);
+      }
+    }
+    Send("\025");
+    Settle(0.1);
+    return ms;
+  }
+  // Runs a trivial command again and again and times each from Enter to the
+  // first line it prints. The screen is redrawn by changed cells only, so
+  // each run prints letters that differ from the last run's in every cell,
+  // and the command line itself never holds them side by side.
+  auto Commands() -> std::vector<double> {
+    std::vector<double> ms;
+    for (int i = 0; i < Opt.Samples; i++) {
+      std::string const tag(2, static_cast<char>('a' + i % 26));
+      Send("printf '%s%s\\n' " + tag + " " + tag);
+      Settle(0.02);
+      size_t const from = Out.size();
+      Send("\r");
+      double const t = WaitFor(tag + tag, from);
+      if (t >= 0) {
+        ms.push_back(t * 1000.0);
+      }
+      Settle(0.02);
+    }
+    return ms;
+  }
+  // Streams 'Bytes' of text through the shell in 79-column lines and
+  // returns the rate in MB/s until the marker after it shows.
+  auto Throughput() -> double {
+    Send("head -c " + std::to_string(Opt.Bytes) +
+         " /dev/zero | tr '\\0' x | fold -w 79; printf 'T%sU\\n' done");
+    Settle(0.05);
+    size_t const from = Out.size();
+    Send("\r");
+    double const t = WaitFor("TdoneU", from);
+    Settle(0.2);
+    return (t > 0) ? static_cast<double>(Opt.Bytes) / t / 1e6 : 0;
+  }
+  // Pastes a script of 'PasteKb' in one bracketed paste, comment lines and
+  // then a command, and times it from the start of the paste to the
+  // command's output.
+  auto Paste() -> double {
+    std::string text;
+    while (text.size() < static_cast<size_t>(Opt.PasteKb) * 1024) {
+      text += "#" + std::string(78, 'x') + "\n";
+    }
+    text += "printf 'P%sQ\\n' 1";
+    size_t const from = Out.size();
+    double const start = Now();
+    Send("\033[200~" + text + "\033[201~\r");
+    double const t = WaitFor("P1Q", from);
+    Settle(0.2);
+    return (t >= 0) ? (Now() - start) * 1000.0 : -1;
+  }
+  // Returns the shell's CPU use in percent of one core while it sits idle
+  // at the prompt.
+  auto Idle() -> double {
+    Settle(0.3);
+    double const cpu = Cpu();
+    double const start = Now();
+    while (Now() - start < Opt.IdleSeconds) {
+      Pump(50);
+    }
+    return (Cpu() - cpu) / (Now() - start) * 100.0;
+  }
+  // Runs every workload and returns the results as JSON.
+  auto Run() -> std::string {
+    std::string json = "{";
+    json += Json("keystroke_echo", Summarize(Keystrokes())) + ",";
+    json += Json("command_first_output", Summarize(Commands())) + ",";
+    char buf[256];
+    double const rate = Throughput();
+    double const paste = Paste();
+    double const idle = Idle();
+    snprintf(buf, sizeof(buf),
+             "\"throughput_mb_s\":%.2f,\"throughput_bytes\":%ld,"
+             "\"paste_ms\":%.3f,\"paste_kb\":%ld,\"idle_cpu_percent\":%.3f,"
+             "\"peak_rss_kb\":%ld}\n",
+             rate, Opt.Bytes, paste, Opt.PasteKb, idle, PeakRss());
+    return json + buf;
+  }
+};
+auto main(int argc, char *argv[]) -> int {
+  Bench::Options opt;
+  for (int i = 1; i < argc; i += 2) {
+    std::string const flag = (i + 1 < argc) ? argv[i] : "";
+    const char *value = argv[i + 1];
+    if (flag == "--bin") {
+      opt.Bin = value;
+    } else if (flag == "--out") {
+      opt.Out = value;
+    } else if (flag == "--samples") {
+      opt.Samples = atoi(value);
+    } else if (flag == "--bytes") {
+      opt.Bytes = atol(value);
+    } else if (flag == "--paste-kb") {
+      opt.PasteKb = atol(value);
+    } else if (flag == "--idle-seconds") {
+      opt.IdleSeconds = atof(value);
+    } else {
+      fprintf(stderr,
+              "usage: %s [--bin path] [--out file] [--samples n] "
+              "[--bytes n] [--paste-kb n] [--idle-seconds s]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+  Bench bench(opt);
+  if (!bench.Start()) {
+    fprintf(stderr, "could not start %s\n", opt.Bin.c_str());
+    return 1;
+  }
+  std::string const json = bench.Run();
+  bench.Stop();
+  FILE *out = opt.Out.empty() ? stdout : fopen(opt.Out.c_str(), "w");
+  if (out == nullptr) {
+    fprintf(stderr, "could not open %s\n", opt.Out.c_str());
+    return 1;
+  }
+  fputs(json.c_str(), out);
+  if (out != stdout) {
+    fclose(out);
+  }
+  return 0;
+}
+} // namespace Origin
+int main(int argc, char *argv[]) { return Origin::main(argc, argv); }
@@ -1,12 +1,30 @@
 #ifndef RC_HPP
 #define RC_HPP
+#include "arena.hpp"
+#include "builtin.hpp"
+#include "complete.hpp"
 #include "console.hpp"
+#include "event.hpp"
 #include "gui.hpp"
+#include "history.hpp"
+#include "jobs.hpp"
+#include "keyboard.hpp"
+#include "lineedit.hpp"
+#include "profile.hpp"
+#include "prompt.hpp"
+#include "screen.hpp"
+#include "scrollback.hpp"
+#include "shellcmds.hpp"
+#include "snapshot.hpp"
+#include "terminal.hpp"
 #include "timer.hpp"
+#include "utf8.hpp"
 #include "util.hpp"
+#include <atomic>
 #include <chrono>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <stdexcept>
 #include <stdio.h>
@@ -18,17 +36,67 @@ using namespace std;
 class App {
 private:
   int *p{nullptr};
-  pthread_mutex_t *Mutex{nullptr};
   std::string Output{};
-  std::string Input{};
   int RunState{};
   long Cycles{};
   long MaxCycles{};
   bool Status{};
   Console *Con{nullptr};
-  Timer *TimerArr[8];
-  std::string TimerText{};
-  std::string ExecText{};
+  Jobs *Procs{nullptr};
+  Builtins *Cmds{nullptr};
+  History *Hist{nullptr};
+  Completer *Comp{nullptr};
+  Prompt *Ps1{nullptr};
+  /* Jobs that had finished at the last publish; when it changes the prompt
+  takes the new exit status and git state. */
+  size_t Finished{0};
+  /* The history entry being shown while browsing with the arrow keys, or -1,
+  with the line being edited before browsing started, whose text also serves
+  as the prefix entries must match. */
+  long HistPos{-1};
+  std::string HistSaved{};
+  /* Reverse incremental search state: the query typed so far, the entry it
+  matched or -1, and the input to restore if the search is cancelled. */
+  bool Searching{false};
+  std::string SearchQuery{};
+  long SearchMatch{-1};
+  std::string SearchSaved{};
+  Scrollback *Log{nullptr};
+  /* The terminal command output and the shell's own messages are written
+  into; rows it scrolls off go to Log. */
+  Terminal *Term{nullptr};
+  /* How many lines the view is scrolled up from the newest output, and the
+  line count it was anchored at. */
+  size_t ScrollOffset{0};
+  size_t ScrollLines{0};
+  Screen *Scr{nullptr};
+  EventLoop *Events{nullptr};
+  Keyboard *Kbd{nullptr};
+  LineEdit *Line{nullptr};
+  Publisher<Snapshot> *View{nullptr};
+  /* The timer value shown while paused and whether it was moving at the last
+  publish, kept by the main thread. */
+  nanoseconds TimerFrozen{nanoseconds::zero()};
+  bool TimerTicking{false};
+  /* When the last snapshot was published, and whether output has arrived
+  since that is not in it yet. */
+  nanoseconds Published{nanoseconds::zero()};
+  bool Unpublished{false};
+  /* Size of the terminal, stored by the renderer whenever the terminal is
+  resized and read by the main thread to size the output tail it publishes. */
+  std::atomic<int> Rows{25};
+  std::atomic<int> Cols{80};
+  /* When the renderer finished its first frame, or 0, whether the main
+  thread has since started the work left until then, and where the startup
+  profile goes: a JSON file, or the scrollback when empty. */
+  std::atomic<nanoseconds::rep> FirstFrame{0};
+  bool Warm{false};
+  std::string StartupFile{};
+  /* Timers are made on first use by GetTimer(); only the run timer is. */
+  Timer *TimerArr[8]{};
+  /* The renderer's frame text and where each of its parts ends. */
+  Arena FrameText;
+  size_t TextEnds[6]{};
   char Buffer[1024] = {0};
   float Slider{0.0f};
   /* An array of run states in string form, sorted to form a doubly linked list
@@ -72,58 +140,154 @@ switch. Uses the constants above as specifiers for the equivalent index. */
                                "exit",   "7", "kill",  "8"};
 
   const int CmdMap[16] = {1, 1, 3, 3, 5, 5, 7, 7, 9, 9, 11, 11, 13, 13, 15, 15};
-  const std::string CmdArg[16] = {"", "", "", "", "", "", "", "",
-                                  "", "", "", "", "", "", "", ""};
   const int AllTxt = -1, PromptTxt = 0, StateTxt = 1, CycleTxt = 2,
-            TimerTxt = 3, ExecTxt = 4;
+            TimerTxt = 3, JobTxt = 4, ExecTxt = 5;
+  /* Rows taken by the text above the output: prompt, state, cycles, timer
+  and the blank line before the output. */
+  static const int HeaderRows = 5;
+  /* Tags identifying the descriptors the main loop waits on. */
+  static const uint32_t InputEvent = 0, ExecEvent = 1, CompleteEvent = 2,
+                        PromptEvent = 3;
+  /* The renderer's frame period, 120 frames per second. */
+  static constexpr nanoseconds FrameTime{8333333};
+  // Creates the subsystems. The history and completion indexes are built by
+  // helper threads, and the GUI context is left to whatever starts the first
+  // GUI frame, so nothing here scans files or directories.
   inline void NewVar() {
-    for (int i = 0; i < 8; i++) {
-      TimerArr[i] = new Timer;
-    }
     Con = new struct Console;
-    Mutex = new pthread_mutex_t;
+    Procs = new Jobs;
+    Startup::Mark("jobs");
+    Log = new Scrollback;
+    Term = new Terminal;
+    Term->SetScrollback(Log);
+    Procs->SetSink(Term);
+    Startup::Mark("terminal");
+    Cmds = new Builtins;
+    Cmds->SetWriter([this](int, std::string_view text) {
+      Term->Append(text.data(), text.size());
+    });
+    Procs->SetBuiltins(Cmds);
+    Hist = new History;
+    Startup::Mark("history");
+    Comp = new Completer;
+    Startup::Mark("completer");
+    Ps1 = new Prompt;
+    Startup::Mark("prompt");
+    Scr = new Screen;
+    Events = new EventLoop;
+    Kbd = new Keyboard;
+    Line = new LineEdit;
+    View = new Publisher<Snapshot>;
     p = new int;
+    Startup::Mark("screen");
   }
   inline void DeleteVar() {
     for (int i = 0; i < 8; i++) {
       delete TimerArr[i];
     }
     delete Con;
-    delete Mutex;
+    delete Procs;
+    delete Cmds;
+    delete Hist;
+    delete Comp;
+    delete Ps1;
+    delete Term;
+    delete Log;
+    delete Scr;
+    delete Events;
+    delete Kbd;
+    delete Line;
+    delete View;
     delete p;
   }
 
 public:
   App(int argc, char **argv) {
     NewVar();
-    *Con = Console();
-    *Mutex = PTHREAD_MUTEX_INITIALIZER;
     *p = 0;
     SetState(Uninitialized);
     Cycles = 0;
     MaxCycles = 1000000000;
+    RegisterBuiltins();
+    Startup::Mark("builtins");
   }
   ~App() { DeleteVar(); };
+  // Sends the startup profile to a JSON file instead of the scrollback.
+  auto SetStartupFile(const std::string &path) -> void { StartupFile = path; }
 
   // The main loop of the application. Splits the output into a separate thread
-  // and continues updating the input status until the application is exited or
-  // a time limit is reached.
+  // and then sleeps until a key arrives, the running command produces output
+  // or the periodic tick fires, until the application is exited or a time
+  // limit is reached. Output is coalesced: while a job floods the terminal it
+  // is read as fast as it comes, and the screen state is published at most
+  // once per frame, since the renderer could not show the states in between.
   auto loop(nanoseconds runtime) -> int {
-    mutexInit();
     if (runtime > nanoseconds::zero()) {
-      TimerArr[0]->SetLimit(runtime);
+      GetTimer(0)->SetLimit(runtime);
     }
+    // The prompt is published before the renderer starts, so its first frame
+    // already shows it.
+    Publish();
+    Startup::Mark("first prompt");
+    Con->EnableRawMode();
+    Events->Add(STDIN_FILENO, InputEvent);
+    Events->Add(Procs->GetFd(), ExecEvent);
+    if (Comp->GetFd() != -1) {
+      Events->Add(Comp->GetFd(), CompleteEvent);
+    }
+    Events->Add(Ps1->GetFd(), PromptEvent);
+    Events->SetTick(milliseconds(100));
+    Startup::Mark("raw mode");
     std::thread thread{[this]() { this->ProcessOutput(); }};
     thread.detach();
-    CHECKVERSION();
-    Gui::CreateContext();
-    IO &io = Gui::GetIO();
+    Startup::Mark("renderer");
     while ((GetState() < Exited) &&
-           (TimerArr[0]->GetRemaining() > nanoseconds::zero())) {
-      ProcessInput();
+           (GetTimer(0)->GetRemaining() > nanoseconds::zero())) {
+      int const ready = Events->Wait(PublishTimeout());
+      bool output = ready > 0;
+      for (int i = 0; i < ready; i++) {
+        switch (Events->GetTag(i)) {
+        case InputEvent:
+          output = false;
+          if (ProcessInput() != 0) {
+            Events->Remove(STDIN_FILENO);
+          }
+          break;
+        case ExecEvent:
+          ProcessExec(false);
+          break;
+        case CompleteEvent:
+          Comp->Refresh();
+          break;
+        case PromptEvent:
+          output = false;
+          Ps1->Collect();
+          break;
+        case EventLoop::TickEvent:
+          // Polling every job on the tick too is a fallback for a child whose
+          // SIGCHLD was missed.
+          output = false;
+          ProcessExec(true);
+          break;
+        default:
+          break;
+        }
+      }
+      if (!Warm && FirstFrame.load() != 0) {
+        WarmUp();
+      }
       ProcessGui();
       ProcessCycles();
+      // Keys and ticks publish at once, as does output once the job is done;
+      // output from a busy job waits for the frame.
+      if (output && Procs->IsBusy() &&
+          Timer::GetNow() - Published < FrameTime) {
+        Unpublished = true;
+      } else {
+        Publish();
+      }
     }
+    Con->DisableRawMode();
     return 0;
   }
   // Sets the run state of the application to 'Initializing' and Upon success,
@@ -140,7 +304,7 @@ public:
   // commands. Upon success,the run state is set to 'Started'.
   auto DoStart() -> bool {
     if (SetState(Starting)) {
-      TimerArr[0]->Start();
+      GetTimer(0)->Start();
       return SetState(Started);
     }
     return false;
@@ -151,7 +315,7 @@ public:
   // point it continues from where it left off.
   auto DoPause() -> bool {
     if (SetState(Pausing)) {
-      TimerArr[0]->Pause();
+      GetTimer(0)->Pause();
       return SetState(Paused);
     }
     return false;
@@ -163,7 +327,7 @@ public:
   // continues from where it left off.
   auto DoResume() -> bool {
     if (SetState(Resuming)) {
-      TimerArr[0]->Resume();
+      GetTimer(0)->Resume();
       return SetState(Resumed);
     }
     return false;
@@ -173,7 +337,7 @@ public:
   // The only applicable commands are 'start', 'restart' and 'exit'.
   auto DoStop() -> bool {
     if (SetState(Stopping)) {
-      TimerArr[0]->Stop();
+      GetTimer(0)->Stop();
       ResetCycles();
       return SetState(Stopped);
     }
@@ -185,9 +349,8 @@ public:
   // Variables are reset to their initial values.
   auto DoRestart() -> bool {
     if (SetState(Restarting)) {
-      TimerArr[0]->Restart();
-      Output.clear();
-      Input.clear();
+      GetTimer(0)->Restart();
+      Line->Clear();
       ResetCycles();
       return SetState(Restarted);
     }
@@ -222,22 +385,11 @@ public:
   auto GetStateNext(int state) -> const int (*)[8] { return &RunMap[state]; }
   // Returns the string representation of a given run state.
   auto GetStateString(int state) -> std::string { return RunStates[state]; }
-  auto GetArg(const std::string &command) -> std::string {
-    for (int i = 0; i < 16; i++) {
-      if (Cmd[i] == command) {
-        return CmdArg[i];
-      }
-    }
-    return "";
-  }
-  // Finds the index of a given command from its string representation.
+  // Finds the run state a given command switches to from its string
+  // representation, or -1 if it is not a run state command.
   auto GetCmd(const std::string &command) -> int {
-    for (int i = 0; i < 16; i++) {
-      if (Cmd[i] == command) {
-        return CmdMap[i];
-      }
-    }
-    return -1;
+    int const index = Builtins::Find(command);
+    return (index >= 0 && index < 16) ? CmdMap[index] : -1;
   }
   // Returns the string representation of a given command from its index.
   auto GetCmd(int index) -> int { return CmdMap[index]; }
@@ -252,14 +404,8 @@ public:
   // Returns true if the application is in the specified state.
   auto Is(int state) const -> bool { return (RunState == state); }
   auto GetState() const -> int { return RunState; }
-  auto GetOutput() -> std::string { return Output; }
-  auto GetInput() -> std::string { return Input; }
-  auto GetMutex() -> pthread_mutex_t * { return Mutex; }
-  auto mutexLock() -> int { return pthread_mutex_lock(Mutex); }
-  auto mutexUnlock() -> int { return pthread_mutex_unlock(Mutex); }
-  auto mutexTryLock() -> int { return pthread_mutex_trylock(Mutex); }
-  auto mutexDestroy() -> int { return pthread_mutex_destroy(Mutex); }
-  auto mutexInit() -> int { return pthread_mutex_init(Mutex, nullptr); }
+  auto GetOutput() const -> const std::string & { return Output; }
+  auto GetInput() -> const std::string & { return Line->Text(); }
   static auto GetThreadId() -> std::thread::id {
     return std::this_thread::get_id();
   }
@@ -287,54 +433,156 @@ public:
     Status = status;
     return Status;
   }
-  auto GetText(int name, const std::string &dlim = "\n") -> std::string {
-    std::string txt[] = {
-        (">-(" + Con->GetUser() + "@" + Console::GetHostname() + ")-$ [" +
-         GetInput() + "]" + dlim),
-        (" (State)=[" + GetStateString(GetState()) + "]" + dlim),
-        (" (Cycles)=[" + ToString(GetCycles()) + "]" + dlim),
-        (" (Timer)=[" + ToString(TimerArr[0]->GetElapsed()) + "s]" + dlim),
-        (dlim + ExecText + dlim)};
-    if (IsRunning()) {
-      TimerText = txt[TimerTxt];
-    } else if (TimerArr[0]->IsRunning()) {
-      txt[TimerTxt] = TimerText;
-    }
-    std::string txt_out;
-    if (name >= 0 && name < 5) {
-      txt_out = txt[name];
-    } else if (name == AllTxt) {
-      for (int i = 0; i < 5; i++) {
-        txt_out += txt[i];
+  // Returns timer 'i', creating it on first use.
+  auto GetTimer(int i) -> Timer * {
+    if (TimerArr[i] == nullptr) {
+      TimerArr[i] = new Timer;
+    }
+    return TimerArr[i];
+  }
+  // Builds the text of the frame into a per-frame arena from a published
+  // snapshot, rather than from the live application state, recording where
+  // each part ends. Only the renderer calls this, and the text lives until
+  // its next call, so composing a frame does not allocate.
+  auto ComposeText(const Snapshot &snap) -> void {
+    nanoseconds elapsed = snap.Elapsed;
+    if (snap.Ticking) {
+      elapsed += Timer::GetNow() - snap.Since;
+    }
+    Arena &out = FrameText;
+    out.Reset();
+    out.Put(snap.Prompt);
+    out.Put('[');
+    out.Put(snap.Input);
+    out.Put("]\n");
+    TextEnds[PromptTxt] = out.Size();
+    out.Put(" (State)=[");
+    out.Put(RunStates[snap.State]);
+    out.Put("]\n");
+    TextEnds[StateTxt] = out.Size();
+    out.Put(" (Cycles)=[");
+    out.Put(snap.Cycles);
+    out.Put("]\n");
+    TextEnds[CycleTxt] = out.Size();
+    out.Put(" (Timer)=[");
+    out.Put(elapsed);
+    out.Put("s]\n");
+    TextEnds[TimerTxt] = out.Size();
+    out.Put(snap.Jobs);
+    TextEnds[JobTxt] = out.Size();
+    out.Put('\n');
+    TextEnds[ExecTxt] = out.Size();
+  }
+  // Returns one part of the last composed frame without its line ending, all
+  // of it for AllTxt, or nothing for a name outside the parts.
+  auto GetText(int name) const -> std::string_view {
+    if (name == AllTxt) {
+      return FrameText.View();
+    }
+    if (name < 0 ||
+        name >= static_cast<int>(sizeof(TextEnds) / sizeof(TextEnds[0]))) {
+      return std::string_view();
+    }
+    size_t const from = (name > 0) ? TextEnds[name - 1] : 0;
+    size_t to = TextEnds[name];
+    to -= (to > from && FrameText.View(to - 1, to)[0] == '\n') ? 1 : 0;
+    return FrameText.View(from, to);
+  }
+  // Returns how long the main loop may sleep, in milliseconds, before
+  // coalesced output is due to be published, or -1 if none is waiting.
+  auto PublishTimeout() -> int {
+    if (!Unpublished) {
+      return -1;
+    }
+    nanoseconds const left = Published + FrameTime - Timer::GetNow();
+    return (left > nanoseconds::zero())
+               ? static_cast<int>(ceil<milliseconds>(left).count())
+               : 0;
+  }
+  // Copies the state the renderer draws into the writer's snapshot and
+  // publishes it. Only the window of scrollback lines that fits on the
+  // terminal is copied. Called by the main thread only.
+  auto Publish() -> void {
+    Published = Timer::GetNow();
+    Unpublished = false;
+    Snapshot &snap = View->GetBack();
+    snap.Input = Line->Text();
+    snap.Cursor = Line->GetCursor();
+    if (Searching) {
+      snap.Input = "(reverse-i-search)`" + SearchQuery + "': ";
+      if (SearchMatch >= 0) {
+        snap.Input += Hist->Get(static_cast<size_t>(SearchMatch));
       }
+      snap.Cursor = snap.Input.size();
+    }
+    snap.State = RunState;
+    snap.Cycles = Cycles;
+    snap.Ticking = IsRunning();
+    snap.Since = Timer::GetNow();
+    if (snap.Ticking || TimerTicking) {
+      TimerFrozen = GetTimer(0)->GetElapsed();
+    } else if (!GetTimer(0)->IsRunning()) {
+      TimerFrozen = nanoseconds::zero();
+    }
+    snap.Elapsed = TimerFrozen;
+    TimerTicking = snap.Ticking;
+    Procs->Describe(snap.Jobs, static_cast<size_t>(Rows.load() / 4),
+                    static_cast<size_t>(Cols.load()));
+    if (Procs->GetFinished() != Finished) {
+      Finished = Procs->GetFinished();
+      Ps1->SetStatus(Procs->GetLast());
+      Ps1->Refresh();
+    }
+    Ps1->SetJobs(Procs->Background());
+    snap.Prompt = Ps1->GetText();
+    // The job lines do not shrink the terminal, as resizing it would signal
+    // the foreground program each time a job starts or ends; the renderer
+    // leaves out the top rows they push below the screen instead.
+    int const rows = Rows.load() - HeaderRows;
+    int const cols = Cols.load();
+    Term->Resize(cols, (rows > 1) ? rows : 1);
+    Procs->SetSize(cols, (rows > 1) ? rows : 1);
+    snap.CellCols = Term->GetWidth();
+    // Scrolled back, the view runs on from the scrollback into the rows of
+    // the terminal in use; otherwise it is the terminal alone.
+    size_t const saved = Log->LineCount();
+    size_t const used = static_cast<size_t>(Term->Used());
+    size_t const lines = saved + used;
+    if (ScrollOffset > 0) {
+      ScrollOffset += lines - ScrollLines;
+    }
+    ScrollLines = lines;
+    if (ScrollOffset == 0) {
+      snap.Exec.clear();
+      Term->CopyRows(0, static_cast<int>(used), snap.Cells);
+      View->Publish();
+      return;
     }
-    return txt_out;
+    size_t const visible = static_cast<size_t>((rows > 1) ? rows : 1);
+    size_t const last = (lines > ScrollOffset) ? lines - ScrollOffset : 0;
+    size_t const first = (last > visible) ? last - visible : 0;
+    size_t const split = std::min(last, saved);
+    Log->CopyLines(first, (split > first) ? split - first : 0, snap.Exec);
+    size_t const from = (first > saved) ? first - saved : 0;
+    Term->CopyRows(static_cast<int>(from),
+                   static_cast<int>((last > saved) ? last - saved - from : 0),
+                   snap.Cells);
+    View->Publish();
   }
   auto GetStatus() const -> bool { return Status; }
-  auto SetOutput(const std::string output, bool format = false) -> int {
-    Output.clear();
+  auto SetOutput(std::string_view output, bool format = false) -> int {
     if (format) {
-      for (char o : output) {
-        if (o != '\0' && o != '\r') {
-          Output.push_back(o);
-        }
-      }
+      Utf8::Clean(output, Output);
     } else {
       Output = output;
     }
     return 0;
   }
+  // Replaces the input line. Control characters are always dropped, so
+  // 'format' no longer changes anything.
   auto SetInput(const std::string &input, bool format) -> int {
-    Input.clear();
-    if (format) {
-      for (char i : input) {
-        if (i != '\0' && i != '\r' && i != (char)8) {
-          Input += i;
-        }
-      }
-    } else {
-      Input = input;
-    }
+    (void)format;
+    Line->Set(input);
     return 0;
   }
   auto SetState(int target) -> bool {
@@ -358,56 +606,403 @@ public:
   }
 
 private:
+  // Decodes every key waiting on stdin with a single read and applies them in
+  // order, or passes them on undecoded to a foreground program that reads
+  // its terminal key by key. Returns -1 once stdin is closed.
   auto ProcessInput() -> int {
+    Profile::Scope const scope(Profile::InputStage);
     int state = GetState();
     if ((state >= Uninitialized) && (state <= Exited)) {
-      std::string in = GetInput();
-      if (Con->KeyHit() != 0) {
-        int const i = Con->GetChar();
-        char ch = static_cast<char>(i);
-        if ((ch != '\n') && (ch != '\r') && (ch != '\0')) {
-          if (ch == 8 || ch == 127 || ch == 27) {
-            in = in.substr(0, in.size() - 1);
-          } else {
-            in += ch;
-          }
-          in.shrink_to_fit();
-          SetInput(in, true);
-        } else {
-          state = GetCmd(in);
-          if (state != -1) {
-            ProcessState(state);
-          } else if (!in.empty() || ch == '\n') {
-            ExecText = exec(in.c_str());
-          }
-          SetInput("", false);
-        }
+      bool closed = false;
+      if (Procs->IsRaw()) {
+        std::string_view const typed = Kbd->ReadRaw(STDIN_FILENO, closed);
+        Procs->Input(typed.data(), typed.size());
+        ScrollOffset = 0;
+        return closed ? -1 : 0;
+      }
+      auto const &keys = Kbd->Read(STDIN_FILENO, closed);
+      if (closed) {
+        return -1;
+      }
+      for (int const key : keys) {
+        ProcessKey(key);
       }
       return 0;
     }
     return -1;
   }
+  // Applies one key. Editing keys go to the line editor; the rest scroll,
+  // browse or search the history, complete, control jobs or submit the line.
+  auto ProcessKey(int key) -> int {
+    if (Searching && SearchKey(key)) {
+      return 0;
+    }
+    if (key == Keyboard::KeyPageUp || key == Keyboard::KeyPageDown) {
+      return Scroll(key == Keyboard::KeyPageUp);
+    }
+    if (key == Keyboard::KeyUp || key == Keyboard::KeyDown) {
+      return Recall(key == Keyboard::KeyUp);
+    }
+    HistPos = -1;
+    if (key == 18) {
+      // Ctrl-R starts a reverse incremental search of the history.
+      Searching = true;
+      SearchQuery.clear();
+      SearchMatch = -1;
+      SearchSaved = Line->Text();
+      return 0;
+    }
+    if (key == '\t') {
+      return Complete();
+    }
+    if (key == Keyboard::KeyPaste) {
+      // A bracketed paste goes into the line in one insertion; its newlines
+      // separate commands when the line is run rather than running it.
+      Line->Insert(Kbd->NextPaste());
+      return 0;
+    }
+    if (key == 3) {
+      // Ctrl-C interrupts the foreground job, or clears the input line.
+      if (!Procs->Interrupt()) {
+        Line->Clear();
+      }
+      return 0;
+    }
+    if (key == 26) {
+      Procs->Suspend();
+      return 0;
+    }
+    if (key == 4 && Line->Empty() && Procs->Input("\004", 1)) {
+      // Ctrl-D on an empty line ends the input of the foreground job.
+      return 0;
+    }
+    if (key != '\n' && key != '\r' && key != '\0') {
+      Line->Key(key);
+      return 0;
+    }
+    Profile::Scope const scope(Profile::DispatchStage);
+    if (!Line->Empty()) {
+      std::string const in = Line->Text();
+      // While a foreground job runs only a line of built-ins, such as 'jobs'
+      // or 'exit', is taken. Anything else is typed into the job's terminal,
+      // which echoes it, or stays in the input if the job reads none.
+      bool const busy = Procs->IsBusy();
+      if (busy && !Procs->IsInline(in)) {
+        if (Procs->Input((in + "\n").data(), in.size() + 1)) {
+          Line->Clear();
+        }
+        return 0;
+      }
+      Hist->Add(in);
+      Term->Append("$ " + in + "\n");
+      if (busy) {
+        Procs->RunInline(in);
+      } else {
+        Procs->Run(in);
+      }
+      ScrollOffset = 0;
+    }
+    Line->Clear();
+    return 0;
+  }
+  // Completes the word before the cursor, listing the candidates in the
+  // scrollback, as many to a line as fit, when it cannot be extended.
+  auto Complete() -> int {
+    std::string head = Line->Text().substr(0, Line->GetCursor());
+    size_t const typed = head.size();
+    const std::vector<std::string> &found = Comp->Complete(head);
+    // Completion only ever extends the word, so the difference is inserted.
+    if (head.size() > typed) {
+      Line->Insert(std::string_view(head).substr(typed));
+    }
+    if (found.empty()) {
+      return 0;
+    }
+    // Paths are listed by their last component only.
+    std::vector<std::string> names;
+    size_t width = 0;
+    for (auto const &name : found) {
+      size_t const slash =
+          (name.size() > 1) ? name.rfind('/', name.size() - 2) : name.npos;
+      names.push_back((slash != name.npos) ? name.substr(slash + 1) : name);
+      width = std::max(width, names.back().size() + 2);
+    }
+    size_t const per =
+        std::max<size_t>(1, static_cast<size_t>(Cols.load()) / width);
+    std::string out;
+    for (size_t i = 0; i < names.size(); i++) {
+      out += names[i];
+      if ((i + 1) % per == 0 || i + 1 == names.size()) {
+        out += "\n";
+      } else {
+        out.append(width - names[i].size(), ' ');
+      }
+    }
+    Term->Append(out);
+    ScrollOffset = 0;
+    return 0;
+  }
+  // Replaces the input with the previous or next history entry that starts
+  // with the line typed before browsing began. Moving past the newest entry
+  // brings that line back.
+  auto Recall(bool older) -> int {
+    if (HistPos < 0) {
+      HistSaved = Line->Text();
+      HistPos = static_cast<long>(Hist->Count());
+    }
+    long const id = Hist->Step(HistSaved, HistPos, older, Line->Text());
+    if (id >= 0) {
+      HistPos = id;
+      Line->Set(Hist->Get(static_cast<size_t>(id)));
+    } else if (!older) {
+      HistPos = static_cast<long>(Hist->Count());
+      Line->Set(HistSaved);
+    }
+    return 0;
+  }
+  // Applies a key during a reverse incremental search. Typing extends the
+  // query, Ctrl-R finds the next older match and Ctrl-G, Escape or Ctrl-C
+  // cancel. Any other key ends the search with the match as the input and
+  // returns false so the key is then handled as usual; Enter runs it.
+  auto SearchKey(int key) -> bool {
+    long const newest = static_cast<long>(Hist->Count());
+    std::string const match = (SearchMatch >= 0)
+                                  ? Hist->Get(static_cast<size_t>(SearchMatch))
+                                  : std::string();
+    if (key == 18) {
+      long const from = (SearchMatch >= 0) ? SearchMatch : newest;
+      long const id = Hist->Search(SearchQuery, from, match);
+      SearchMatch = (id >= 0) ? id : SearchMatch;
+      return true;
+    }
+    if (key == 3 || key == 7 || key == Keyboard::KeyEscape) {
+      Searching = false;
+      Line->Set(SearchSaved);
+      return true;
+    }
+    if (key == 8 || key == 127) {
+      if (!SearchQuery.empty()) {
+        SearchQuery.pop_back();
+      }
+      SearchMatch = SearchQuery.empty()
+                        ? -1
+                        : Hist->Search(SearchQuery, newest, std::string_view());
+      return true;
+    }
+    if (key >= 32 && key < Keyboard::KeyUnknown) {
+      SearchQuery += static_cast<char>(key);
+      // The current match is kept if it still contains the longer query.
+      if (match.find(SearchQuery) == std::string::npos) {
+        SearchMatch = Hist->Search(SearchQuery, newest, std::string_view());
+      }
+      return true;
+    }
+    Searching = false;
+    Line->Set((SearchMatch >= 0) ? match : std::string_view(SearchSaved));
+    return false;
+  }
+  // Binds the run state commands and the other built-ins to their handlers.
+  // Handlers are run by the executor with already expanded arguments.
+  auto RegisterBuiltins() -> void {
+    for (int i = 0; i < 16; i++) {
+      int const state = CmdMap[i];
+      Cmds->Register(Cmd[i], [this, state](const Builtins::Args &) {
+        ProcessState(state);
+        return GetStatus() ? 0 : 1;
+      });
+    }
+    Cmds->Register("cd", [this](const Builtins::Args &args) {
+      int const status = ShellCommands::ChangeDir(args, Cmds->Printer());
+      if (status == 0) {
+        Ps1->SetCwd();
+      }
+      return status;
+    });
+    Cmds->Register("export", [this](const Builtins::Args &args) {
+      return ShellCommands::Export(args, Cmds->Printer());
+    });
+    Cmds->Register("unset", [this](const Builtins::Args &args) {
+      return ShellCommands::Unset(args, Cmds->Printer());
+    });
+    Cmds->Register("stats", [this](const Builtins::Args &args) {
+      return Stats(args);
+    });
+    Cmds->Register("jobs", [this](const Builtins::Args &) {
+      Cmds->Print(1, Procs->List());
+      return 0;
+    });
+    Cmds->Register("fg", [this](const Builtins::Args &args) {
+      return JobCommand(args, Procs->Fg(JobId(args)));
+    });
+    Cmds->Register("bg", [this](const Builtins::Args &args) {
+      return JobCommand(args, Procs->Bg(JobId(args)));
+    });
+    Cmds->Register("wait", [this](const Builtins::Args &args) {
+      return JobCommand(args, Procs->Wait(JobId(args)));
+    });
+    Cmds->Register("history", [this](const Builtins::Args &args) {
+      return ShowHistory(args);
+    });
+  }
+  // Returns the job named by 'fg', 'bg' or 'wait' as 'n' or '%n', or 0 for
+  // the default.
+  static auto JobId(const Builtins::Args &args) -> int {
+    if (args.size() < 2) {
+      return 0;
+    }
+    return atoi(args[1].c_str() + (args[1][0] == '%' ? 1 : 0));
+  }
+  auto JobCommand(const Builtins::Args &args, int rc) -> int {
+    if (rc != 0) {
+      Cmds->Print(2, args[0] + ": " +
+                         (args.size() > 1 ? args[1] : "current") +
+                         ": no such job\n");
+      return 1;
+    }
+    return 0;
+  }
+  // Runs 'history [n]', listing the last n entries, or all of them, numbered
+  // from 1.
+  auto ShowHistory(const Builtins::Args &args) -> int {
+    size_t const count = Hist->Count();
+    size_t const n =
+        (args.size() > 1) ? strtoul(args[1].c_str(), nullptr, 10) : count;
+    std::string out;
+    for (size_t id = (n < count) ? count - n : 0; id < count; id++) {
+      out += std::to_string(id + 1) + "  ";
+      out += Hist->Get(id);
+      out += "\n";
+    }
+    Cmds->Print(1, out);
+    return 0;
+  }
+  // Starts the work left until the prompt is on screen, so that on a busy
+  // or single processor machine it does not delay the first frame: the
+  // history and completion indexes and the prompt's git state. Then closes
+  // the startup profile at that frame and reports it into the scrollback, or
+  // into StartupFile.
+  auto WarmUp() -> void {
+    Warm = true;
+    Hist->Start();
+    Comp->Start();
+    Ps1->Refresh();
+    if (!Startup::IsEnabled()) {
+      return;
+    }
+    Startup::Mark("first frame", nanoseconds(FirstFrame.load()));
+    if (StartupFile.empty()) {
+      Term->Append(Startup::Table());
+    } else if (!Startup::Save(StartupFile)) {
+      Term->Append("startup profile: cannot write " + StartupFile + "\n");
+    }
+  }
+  // Runs 'stats', which reports per-stage timings into the scrollback.
+  // 'stats json' reports them as JSON, 'stats json <file>' writes the JSON to
+  // a file and 'stats reset' clears them.
+  auto Stats(const Builtins::Args &args) -> int {
+    std::string const arg = (args.size() > 1) ? args[1] : "";
+    if (arg.empty()) {
+      Cmds->Print(1, Profile::Table());
+    } else if (arg == "json" && args.size() == 2) {
+      Cmds->Print(1, Profile::Json());
+    } else if (arg == "json") {
+      std::ofstream file(args[2], ios::out | ios::trunc);
+      file << Profile::Json();
+      if (!file) {
+        Cmds->Print(2, "stats: cannot write " + args[2] + "\n");
+        return 1;
+      }
+      Cmds->Print(1, "stats written to " + args[2] + "\n");
+    } else if (arg == "reset") {
+      Profile::Reset();
+    } else {
+      Cmds->Print(2, "usage: stats [json [file] | reset]\n");
+      return 1;
+    }
+    return 0;
+  }
+  // Scrolls the output view half a screen up or down.
+  auto Scroll(bool up) -> int {
+    int const rows = (Rows.load() - HeaderRows) / 2;
+    size_t const step = static_cast<size_t>((rows > 1) ? rows : 1);
+    size_t const lines =
+        Log->LineCount() + static_cast<size_t>(Term->Used());
+    if (up) {
+      ScrollOffset += step;
+      if (ScrollOffset >= lines) {
+        ScrollOffset = (lines > 0) ? lines - 1 : 0;
+      }
+    } else {
+      ScrollOffset = (ScrollOffset > step) ? ScrollOffset - step : 0;
+    }
+    return 0;
+  }
+  // Redraws the terminal at up to 120 frames per second from the latest
+  // published snapshot. Frames are only composed when a new snapshot arrived,
+  // the terminal was resized or the run timer is moving, and of those only
+  // the cells that changed are written.
   auto ProcessOutput() -> int {
     nanoseconds TimeMax;
     nanoseconds TimeEnd;
+    Console::WatchResize();
     while (true) {
-      mutexLock();
-      TimeMax = (TimerArr[0]->GetNow() + nanoseconds(8333333));
-      Con->ClearScreen();
-      flush(std::cout);
-      flush(std::cerr);
-      std::string const out = GetText(AllTxt);
-      SetOutput(out, true);
-      std::cout << GetOutput() << std::flush;
-      TimeEnd = (TimerArr[0]->GetNow());
-      mutexUnlock();
+      TimeMax = (Timer::GetNow() + FrameTime);
+      bool redraw = View->Read();
+      if (Con->IsResized()) {
+        Con->UpdateSize();
+        Scr->Resize(Con->Width, Con->Height);
+        Rows.store(Con->Height);
+        Cols.store(Con->Width);
+        redraw = true;
+      }
+      Snapshot const &snap = View->GetFront();
+      if (redraw || snap.Ticking) {
+        {
+          Profile::Scope const scope(Profile::TextStage);
+          ComposeText(snap);
+          SetOutput(GetText(AllTxt), true);
+          int const top = Scr->Layout(GetOutput());
+          Scr->Draw(snap.Cells, snap.CellCols, Scr->Lines(snap.Exec, top));
+          // The cursor sits in the input inside the prompt's brackets, on
+          // whichever row the prompt has wrapped to.
+          std::string_view const prompt = GetText(PromptTxt);
+          auto const cell = Scr->Locate(
+              prompt, prompt.size() - 1 - snap.Input.size() + snap.Cursor);
+          Scr->SetCursor(cell.first, cell.second);
+        }
+        Profile::Scope const scope(Profile::WriteStage);
+        Scr->Flush(*Con);
+        if (FirstFrame.load(std::memory_order_relaxed) == 0) {
+          FirstFrame.store(Timer::GetNow().count());
+        }
+      }
+      TimeEnd = (Timer::GetNow());
       if (TimeEnd < TimeMax) {
         std::this_thread::sleep_for(TimeMax - TimeEnd);
       }
     }
     return 0;
   }
+  // Moves any output the jobs have produced since the last call into the
+  // scrollback or their buffers and reaps children that changed state. The
+  // buffers are only touched by the main thread; the renderer sees them
+  // through the published snapshot.
+  auto ProcessExec(bool every) -> int {
+    Profile::Scope const scope(Profile::ExecStage);
+    Procs->Poll(every);
+    if (every) {
+      Hist->Sync();
+    }
+    return 0;
+  }
+  // Submits the GUI widgets. Widgets can only be submitted between NewFrame()
+  // and EndFrame(), which the terminal path never calls, so nothing is done
+  // outside a frame, or before a GUI context has been created for one.
   auto ProcessGui() -> int {
+    if (GGui == nullptr || !GGui->WithinFrameScope) {
+      return 0;
+    }
+    Profile::Scope const scope(Profile::GuiStage);
     Gui::Text("TShell");
     if (Gui::Button("Start")) {
       DoStart();
@@ -470,24 +1065,6 @@ private:
     }
     return -1;
   }
-  static auto exec(const char *cmd) -> std::string {
-    char buffer[128];
-    std::string result = "";
-    FILE *pipe = popen(cmd, "r");
-    if (pipe == nullptr) {
-      throw std::runtime_error("popen() failed!");
-    }
-    try {
-      while (fgets(buffer, sizeof buffer, pipe) != nullptr) {
-        result += buffer;
-      }
-    } catch (...) {
-      pclose(pipe);
-      throw;
-    }
-    pclose(pipe);
-    return result;
-  }
 }; // namespace run
 } // namespace Origin
 #endif // RC_HPP
\ No newline at end of file
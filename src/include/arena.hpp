@@ -0,0 +1,81 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string_view>
+namespace Origin {
+using namespace std::chrono;
+/* A bump allocator for text that only lives for one frame. Pieces are written
+one after another into a single buffer, Reset() frees all of them at once, and
+numbers are formatted in place with std::to_chars, so once the buffer has grown
+to fit the largest frame seen composing a frame allocates nothing. Pieces are
+addressed by offset, since the buffer moves when it grows. */
+struct Arena {
+private:
+  std::unique_ptr<char[]> Bytes;
+  size_t Capacity{0};
+  size_t Used{0};
+
+  // Returns room for 'count' more bytes, doubling the buffer if need be.
+  auto Bump(size_t count) -> char * {
+    if (Used + count > Capacity) {
+      size_t size = (Capacity > 0) ? Capacity * 2 : 4096;
+      while (size < Used + count) {
+        size *= 2;
+      }
+      std::unique_ptr<char[]> bytes(new char[size]);
+      if (Used > 0) {
+        memcpy(bytes.get(), Bytes.get(), Used);
+      }
+      Bytes = std::move(bytes);
+      Capacity = size;
+    }
+    char *at = Bytes.get() + Used;
+    Used += count;
+    return at;
+  }
+
+public:
+  // Frees every piece, keeping the buffer for the next frame.
+  auto Reset() -> void { Used = 0; }
+  // Returns the offset the next piece starts at.
+  auto Size() const -> size_t { return Used; }
+  auto Put(std::string_view text) -> void {
+    if (!text.empty()) {
+      memcpy(Bump(text.size()), text.data(), text.size());
+    }
+  }
+  auto Put(char c) -> void { *Bump(1) = c; }
+  auto Put(long value) -> void {
+    char buf[24];
+    auto const end = std::to_chars(buf, buf + sizeof(buf), value).ptr;
+    Put(std::string_view(buf, static_cast<size_t>(end - buf)));
+  }
+  // Writes a duration as seconds with six decimals, like '12.000345'.
+  auto Put(nanoseconds time) -> void {
+    long const us = static_cast<long>(time.count() / 1000);
+    if (us < 0) {
+      Put('-');
+    }
+    long const abs = (us < 0) ? -us : us;
+    Put(abs / 1000000);
+    char frac[6];
+    long rest = abs % 1000000;
+    for (int i = 5; i >= 0; i--) {
+      frac[i] = static_cast<char>('0' + rest % 10);
+      rest /= 10;
+    }
+    Put('.');
+    Put(std::string_view(frac, sizeof(frac)));
+  }
+  // Returns the text between two offsets.
+  auto View(size_t from, size_t to) const -> std::string_view {
+    return std::string_view(Bytes.get() + from, to - from);
+  }
+  auto View() const -> std::string_view { return View(0, Used); }
+};
+} // namespace Origin
+#endif // ARENA_HPP
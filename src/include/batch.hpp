@@ -0,0 +1,255 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+#include "builtin.hpp"
+#include "env.hpp"
+#include "exec.hpp"
+#include "parser.hpp"
+#include "profile.hpp"
+#include "shellcmds.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+namespace Origin {
+/* Runs commands without the terminal front end, for 'TShell -c line [name
+args...]', 'TShell script [args...]' and a stdin that is not a terminal. The
+arguments after a script become $1 onwards, as after '-c line', where the
+first of them is $0. There is no render thread,
+GUI context, line editor, pty or scrollback: the executor runs in direct mode,
+so commands read the shell's stdin and write to its stdout and stderr, and the
+shell only sleeps in waitpid() until each pipeline is done. A script given by
+'-c' or as a file goes to the parser at once, whose newlines separate commands
+like ';', so a script using syntax it does not handle runs under /bin/sh in
+one piece. A script on stdin is read one complete command at a time, and
+each runs before the next is read, so commands that read stdin get the lines
+after their own and a producer need not finish first. From the first line
+the parser does not handle, which may open a compound command, the rest of
+stdin is read and runs under /bin/sh in one piece. */
+struct Batch {
+private:
+  /* The executor only keeps output for the terminal, which is not used. */
+  static constexpr size_t RingSize = 4096;
+  Exec Proc{RingSize};
+  Builtins Cmds;
+  /* And-or lists ended by '&', each running in an executor of its own. */
+  std::vector<std::unique_ptr<Exec>> Background;
+  /* Set by 'exit', which ends the script. */
+  bool Exited{false};
+
+  static auto Print(int fd, const std::string &text) -> void {
+    size_t done = 0;
+    while (done < text.size()) {
+      ssize_t const n = write(fd, text.data() + done, text.size() - done);
+      if (n <= 0 && errno != EINTR) {
+        return;
+      }
+      done += (n > 0) ? static_cast<size_t>(n) : 0;
+    }
+  }
+  // Reads the whole of 'fd' into 'out'. Returns false on a read error.
+  static auto ReadAll(int fd, std::string &out) -> bool {
+    char chunk[65536];
+    while (true) {
+      ssize_t const n = read(fd, chunk, sizeof(chunk));
+      if (n > 0) {
+        out.append(chunk, static_cast<size_t>(n));
+      } else if (n == 0) {
+        return true;
+      } else if (errno != EINTR) {
+        return false;
+      }
+    }
+  }
+  // Appends a line of 'fd' to 'out', newline included, without reading past
+  // it. A file is read in blocks and its offset moved back to the end of the
+  // line; a pipe or terminal cannot be, so it is read a byte at a time.
+  // Returns false at the end of the input or on a read error.
+  static auto ReadLine(int fd, std::string &out) -> bool {
+    bool const seekable = lseek(fd, 0, SEEK_CUR) != -1;
+    char chunk[4096];
+    size_t const size = seekable ? sizeof(chunk) : 1;
+    bool any = false;
+    while (true) {
+      ssize_t const n = read(fd, chunk, size);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        return any;
+      }
+      any = true;
+      auto const len = static_cast<size_t>(n);
+      auto const *nl = static_cast<const char *>(memchr(chunk, '\n', len));
+      size_t const used = (nl != nullptr) ? nl - chunk + 1 : len;
+      out.append(chunk, used);
+      if (nl != nullptr) {
+        if (used < len) {
+          lseek(fd, -static_cast<off_t>(len - used), SEEK_CUR);
+        }
+        return true;
+      }
+    }
+  }
+  // Returns true if 'text' ends in an escaped newline, which joins the line
+  // to the next.
+  static auto IsContinued(const std::string &text) -> bool {
+    size_t slashes = 0;
+    for (size_t i = text.size() - 1; i > 0 && text[i - 1] == '\\'; i--) {
+      slashes++;
+    }
+    return slashes % 2 == 1;
+  }
+  // Runs one piece of a script to its end.
+  auto RunPart(const std::string &text) -> void {
+    Proc.Run(text);
+    Proc.Finish();
+  }
+  // Starts a list ended by '&', dropping background jobs that have finished.
+  auto Detach(Script &script) -> void {
+    for (size_t i = Background.size(); i > 0; i--) {
+      Background[i - 1]->Reap();
+      if (!Background[i - 1]->IsRunning()) {
+        Background.erase(Background.begin() + static_cast<long>(i - 1));
+      }
+    }
+    auto job = std::make_unique<Exec>(RingSize);
+    job->SetDirect(true);
+    job->SetBuiltins(&Cmds);
+    job->Isolate();
+    job->Run(std::move(script));
+    Background.push_back(std::move(job));
+  }
+  // Waits for every background job.
+  auto WaitAll() -> void {
+    for (auto &job : Background) {
+      job->Finish();
+    }
+    Background.clear();
+  }
+  // Binds the built-ins that make sense without a terminal. The run state
+  // and job control commands are left to the interactive shell.
+  auto RegisterBuiltins() -> void {
+    Cmds.Register("cd", [this](const Builtins::Args &args) {
+      return ShellCommands::ChangeDir(args, Cmds.Printer());
+    });
+    Cmds.Register("export", [this](const Builtins::Args &args) {
+      return ShellCommands::Export(args, Cmds.Printer());
+    });
+    Cmds.Register("unset", [this](const Builtins::Args &args) {
+      return ShellCommands::Unset(args, Cmds.Printer());
+    });
+    Cmds.Register("exit", [this](const Builtins::Args &args) {
+      Proc.Cancel();
+      Exited = true;
+      return (args.size() > 1) ? atoi(args[1].c_str()) & 255
+                               : Proc.GetLast();
+    });
+    Cmds.Register("wait", [this](const Builtins::Args &) {
+      WaitAll();
+      return 0;
+    });
+  }
+
+public:
+  Batch() {
+    Proc.SetDirect(true);
+    Proc.SetBuiltins(&Cmds);
+    Proc.SetDetach([this](Script &script) { Detach(script); });
+    RegisterBuiltins();
+  }
+  Batch(const Batch &) = delete;
+  auto operator=(const Batch &) -> Batch & = delete;
+  // Runs a script to its end, then waits for its background jobs. Returns
+  // the status of the last command.
+  auto Run(const std::string &text) -> int {
+    Proc.Run(text);
+    Proc.Finish();
+    WaitAll();
+    return Proc.GetLast();
+  }
+  // Runs a script from 'fd' as it is read, one complete command at a time,
+  // then waits for its background jobs. Returns the status of the last
+  // command.
+  auto RunStream(int fd) -> int {
+    std::string text;
+    Script script;
+    while (!Exited && ReadLine(fd, text)) {
+      if (text.back() == '\n' && IsContinued(text)) {
+        continue;
+      }
+      if (!Parser::Parse(text, script)) {
+        if (script.Incomplete) {
+          continue;
+        }
+        // The error is reported by running the line, and ends the script.
+        RunPart(text);
+        text.clear();
+        break;
+      }
+      if (script.Fallback) {
+        ReadAll(fd, text);
+        break;
+      }
+      RunPart(text);
+      text.clear();
+    }
+    if (!Exited && !text.empty()) {
+      RunPart(text);
+    }
+    WaitAll();
+    return Proc.GetLast();
+  }
+  // Runs the shell without a terminal as asked by its arguments: '-c line',
+  // a script file, or a script read from stdin, setting the positional
+  // parameters from the arguments after it. Returns the exit status. A
+  // startup profile being recorded is written to stderr at the end, or as
+  // JSON to 'profile' when that is not empty.
+  static auto Main(int argc, char **argv, const std::string &profile = "")
+      -> int {
+    std::string text;
+    std::vector<std::string> params{argv[0]};
+    if (argc > 1 && strcmp(argv[1], "-c") == 0) {
+      if (argc < 3) {
+        Print(STDERR_FILENO, "tshell: -c: option requires an argument\n");
+        return 2;
+      }
+      text = argv[2];
+      if (argc > 3) {
+        params.assign(argv + 3, argv + argc);
+      }
+    } else if (argc > 1) {
+      params.assign(argv + 1, argv + argc);
+      int const fd = open(argv[1], O_RDONLY | O_CLOEXEC);
+      if (fd == -1 || !ReadAll(fd, text)) {
+        Print(STDERR_FILENO, std::string("tshell: ") + argv[1] + ": " +
+                                 strerror(errno) + "\n");
+        if (fd != -1) {
+          close(fd);
+        }
+        return 127;
+      }
+      close(fd);
+    }
+    Environment::Shell().SetParams(std::move(params));
+    Startup::Mark("read");
+    Batch batch;
+    Startup::Mark("init");
+    int const status =
+        (argc > 1) ? batch.Run(text) : batch.RunStream(STDIN_FILENO);
+    Startup::Mark("run");
+    if (Startup::IsEnabled() && profile.empty()) {
+      Print(STDERR_FILENO, Startup::Table());
+    } else if (Startup::IsEnabled() && !Startup::Save(profile)) {
+      Print(STDERR_FILENO, "tshell: cannot write " + profile + "\n");
+    }
+    return status;
+  }
+};
+} // namespace Origin
+#endif // BATCH_HPP
@@ -0,0 +1,184 @@
+#ifndef BUILTIN_HPP
+#define BUILTIN_HPP
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+namespace Origin {
+/* Names of every built-in, fixed at compile time so they can be perfectly
+hashed. The first sixteen are the run state commands in the order of App::Cmd,
+so their index also indexes App::CmdMap. */
+inline constexpr std::string_view BuiltinNames[] = {
+    "init", "1", "start",   "2", "pause", "3", "resume", "4",
+    "stop", "5", "restart", "6", "exit",  "7", "kill",   "8",
+    "cd",   "export",       "unset", "stats", "jobs", "fg",   "bg",
+    "wait", "history"};
+inline constexpr size_t BuiltinCount =
+    sizeof(BuiltinNames) / sizeof(BuiltinNames[0]);
+inline constexpr size_t BuiltinSlots = 64;
+static_assert(BuiltinCount < BuiltinSlots, "built-in table is too small");
+constexpr auto BuiltinHash(std::string_view name, uint32_t seed) -> uint32_t {
+  uint32_t h = 2166136261u ^ seed;
+  for (char const c : name) {
+    h = (h ^ static_cast<unsigned char>(c)) * 16777619u;
+  }
+  return h ^ (h >> 15);
+}
+// Returns the first seed under which no two built-in names share a slot.
+constexpr auto BuiltinSeed() -> uint32_t {
+  for (uint32_t seed = 0;; seed++) {
+    bool used[BuiltinSlots] = {};
+    bool ok = true;
+    for (size_t i = 0; i < BuiltinCount && ok; i++) {
+      size_t const slot =
+          BuiltinHash(BuiltinNames[i], seed) & (BuiltinSlots - 1);
+      ok = !used[slot];
+      used[slot] = true;
+    }
+    if (ok) {
+      return seed;
+    }
+  }
+}
+// Maps each slot to the index of the name hashed into it, or -1.
+constexpr auto BuiltinTable(uint32_t seed)
+    -> std::array<int8_t, BuiltinSlots> {
+  std::array<int8_t, BuiltinSlots> table{};
+  for (auto &slot : table) {
+    slot = -1;
+  }
+  for (size_t i = 0; i < BuiltinCount; i++) {
+    table[BuiltinHash(BuiltinNames[i], seed) & (BuiltinSlots - 1)] =
+        static_cast<int8_t>(i);
+  }
+  return table;
+}
+/* Commands the shell runs itself instead of spawning a process. A seed for an
+FNV-1a hash is searched for at compile time so that every name in BuiltinNames
+lands in its own slot of a small table. Looking up a line's first word is then
+one hash and one string compare, whatever the number of built-ins. Names
+outside the fixed set can still be registered at run time and are kept in an
+ordinary hash map. Handlers print through Print(), which hands stdout and
+stderr to the front end's writer, or writes them to the shell's own
+descriptors when none is set, unless the executor has redirected them for the
+built-in being run. */
+struct Builtins {
+  using Args = std::vector<std::string>;
+  /* A handler receives the command name in args[0] and returns an exit
+  status. */
+  using Handler = std::function<int(const Args &)>;
+  /* Takes what a handler prints to stdout (1) or stderr (2). */
+  using Writer = std::function<void(int, std::string_view)>;
+
+private:
+  static constexpr uint32_t Seed = BuiltinSeed();
+  static constexpr std::array<int8_t, BuiltinSlots> Table =
+      BuiltinTable(Seed);
+
+  Handler Handlers[BuiltinCount];
+  std::unordered_map<std::string, Handler> Extra;
+  Writer Out;
+  /* For stdin, stdout and stderr, the descriptor a redirection sent it to,
+  or -1, and otherwise the stream of the writer it goes to. */
+  int Route[3]{-1, -1, -1};
+  int Stream[3]{0, 1, 2};
+
+  auto Lookup(std::string_view name) -> Handler * {
+    int const index = Find(name);
+    if (index >= 0) {
+      return Handlers[index] ? &Handlers[index] : nullptr;
+    }
+    if (!Extra.empty()) {
+      auto const it = Extra.find(std::string(name));
+      if (it != Extra.end()) {
+        return &it->second;
+      }
+    }
+    return nullptr;
+  }
+
+public:
+  // Returns the index of a name in the fixed set, or -1.
+  static constexpr auto Find(std::string_view name) -> int {
+    int const index = Table[BuiltinHash(name, Seed) & (BuiltinSlots - 1)];
+    return (index >= 0 && BuiltinNames[index] == name) ? index : -1;
+  }
+  // Binds a handler to a name. Returns false if the name is already bound.
+  auto Register(std::string_view name, Handler handler) -> bool {
+    int const index = Find(name);
+    if (index >= 0) {
+      if (Handlers[index]) {
+        return false;
+      }
+      Handlers[index] = std::move(handler);
+      return true;
+    }
+    return Extra.emplace(std::string(name), std::move(handler)).second;
+  }
+  // Returns true if a handler is bound to a name.
+  auto Has(std::string_view name) -> bool { return Lookup(name) != nullptr; }
+  // Sets what handlers print goes to when it is not redirected.
+  auto SetWriter(Writer out) -> void { Out = std::move(out); }
+  // Prints text to stdout (1) or stderr (2) of the running built-in.
+  auto Print(int fd, std::string_view text) -> void {
+    fd = (fd == 2) ? 2 : 1;
+    if (Route[fd] == -1 && Out) {
+      Out(Stream[fd], text);
+      return;
+    }
+    int const to = (Route[fd] != -1) ? Route[fd] : Stream[fd];
+    while (!text.empty()) {
+      ssize_t const n = write(to, text.data(), text.size());
+      if (n <= 0 && errno != EINTR) {
+        return;
+      }
+      text.remove_prefix((n > 0) ? static_cast<size_t>(n) : 0);
+    }
+  }
+  // Returns a writer that prints through Print(), for code shared between
+  // front ends.
+  auto Printer() -> Writer {
+    return [this](int fd, std::string_view text) { Print(fd, text); };
+  }
+  // Sends descriptor 'fd' of the next built-in run to descriptor 'to' of the
+  // shell. Only stdout and stderr are used.
+  auto Redirect(int fd, int to) -> void {
+    if (fd >= 0 && fd < 3) {
+      Route[fd] = to;
+      Stream[fd] = fd;
+    }
+  }
+  // Makes descriptor 'fd' of the next built-in run a copy of 'from', as
+  // '2>&1' does.
+  auto Duplicate(int fd, int from) -> void {
+    if (fd < 0 || fd >= 3) {
+      return;
+    }
+    Route[fd] = (from >= 0 && from < 3) ? Route[from] : from;
+    Stream[fd] = (from >= 0 && from < 3) ? Stream[from] : fd;
+  }
+  // Undoes every Redirect() and Duplicate().
+  auto Restore() -> void {
+    for (int fd = 0; fd < 3; fd++) {
+      Route[fd] = -1;
+      Stream[fd] = fd;
+    }
+  }
+  // Runs args[0] with the given arguments. Returns -1 without doing anything
+  // if it is not a built-in, otherwise the handler's exit status.
+  auto Run(const Args &args) -> int {
+    if (args.empty()) {
+      return -1;
+    }
+    Handler *handler = Lookup(args[0]);
+    return (handler != nullptr) ? (*handler)(args) : -1;
+  }
+};
+} // namespace Origin
+#endif // BUILTIN_HPP
@@ -0,0 +1,87 @@
+#ifndef CELL_HPP
+#define CELL_HPP
+#include <cstdint>
+#include <string>
+namespace Origin {
+/* One character cell of the terminal: what is in it and how it is drawn.
+Code is a Unicode code point; the cell right of a wide character holds
+WideTail. The low byte of Flags holds the style bits and the rest one
+combining mark drawn over the character. Colours are palette indexes 0-255,
+24-bit colours tagged with TrueColor, or DefaultColor for the terminal's
+own. */
+struct Cell {
+  static constexpr uint32_t DefaultColor = 0xffffffff;
+  static constexpr uint32_t TrueColor = 0x1000000;
+  static constexpr uint32_t Bold = 1, Faint = 2, Italic = 4, Underline = 8,
+                            Blink = 16, Inverse = 32, Hidden = 64,
+                            Strike = 128;
+  static constexpr uint32_t StyleMask = 0xff;
+  static constexpr int MarkShift = 8;
+  static constexpr uint32_t WideTail = 0;
+  uint32_t Code{' '};
+  uint32_t Fg{DefaultColor};
+  uint32_t Bg{DefaultColor};
+  uint32_t Flags{0};
+
+  auto operator==(const Cell &other) const -> bool {
+    return Code == other.Code && Fg == other.Fg && Bg == other.Bg &&
+           Flags == other.Flags;
+  }
+  auto operator!=(const Cell &other) const -> bool {
+    return !(*this == other);
+  }
+  // Returns true if both cells are drawn with the same colours and flags.
+  auto SameStyle(const Cell &other) const -> bool {
+    return Fg == other.Fg && Bg == other.Bg &&
+           ((Flags ^ other.Flags) & StyleMask) == 0;
+  }
+  // Returns the combining mark on this cell, or 0.
+  auto GetMark() const -> uint32_t { return Flags >> MarkShift; }
+  // Sets the combining mark, unless the cell already has one.
+  auto SetMark(uint32_t mark) -> void {
+    if (GetMark() == 0) {
+      Flags |= mark << MarkShift;
+    }
+  }
+  // Sets 'out' to the SGR sequence that selects this cell's style from a
+  // reset, so it can be compared with the last one written.
+  auto Style(std::string &out) const -> void {
+    static const char *const codes[] = {";1", ";2", ";3", ";4",
+                                        ";5", ";7", ";8", ";9"};
+    out = "\033[0";
+    for (int i = 0; i < 8; i++) {
+      if ((Flags & (1u << i)) != 0) {
+        out += codes[i];
+      }
+    }
+    Color(out, Fg, 30, 90, 38);
+    Color(out, Bg, 40, 100, 48);
+    out += 'm';
+  }
+
+private:
+  // Appends the parameters selecting one colour: 'base' plus the index for
+  // the first eight, 'bright' plus it for the next eight, and the extended
+  // forms after 'extended' for the rest.
+  static auto Color(std::string &out, uint32_t color, int base, int bright,
+                    int extended) -> void {
+    if (color == DefaultColor) {
+      return;
+    }
+    out += ';';
+    if (color < 8) {
+      out += std::to_string(base + static_cast<int>(color));
+    } else if (color < 16) {
+      out += std::to_string(bright + static_cast<int>(color) - 8);
+    } else if (color < 256) {
+      out += std::to_string(extended) + ";5;" + std::to_string(color);
+    } else {
+      out += std::to_string(extended) + ";2;" +
+             std::to_string((color >> 16) & 0xff) + ";" +
+             std::to_string((color >> 8) & 0xff) + ";" +
+             std::to_string(color & 0xff);
+    }
+  }
+};
+} // namespace Origin
+#endif // CELL_HPP
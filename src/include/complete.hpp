@@ -0,0 +1,302 @@
+#ifndef COMPLETE_HPP
+#define COMPLETE_HPP
+#include "builtin.hpp"
+#include "pathdirs.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <dirent.h>
+#include <fcntl.h>
+#include <string>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+namespace Origin {
+/* Completes the word at the end of the input line: a command name in command
+position, a path anywhere else. Command names come from the built-ins and an
+index of every executable in the $PATH directories. The index is built once
+by a helper thread, started by Start() or the first completion, that scans
+the directories in parallel with raw getdents64 reads, and is kept current by
+the shared PathDirs watches: a directory is rescanned only when an event names
+it, when the main loop sees the inotify descriptor become readable, so pressing
+Tab never touches the PATH directories. A directory that cannot be watched, as
+when the inotify instance or watch limit is exhausted, is rescanned on every
+Tab instead. The index is rebuilt only if $PATH itself changes. */
+struct Completer {
+private:
+  /* One absolute $PATH directory, its index in the shared list, the count
+  of its changes when it was scanned, and the executables found in it. */
+  struct Dir {
+    std::string Path{};
+    size_t Source{0};
+    uint64_t Seen{0};
+    std::vector<std::string> Names{};
+  };
+  /* The fixed layout of a getdents64 record, whose name runs to the end. */
+  struct Dirent64 {
+    uint64_t Ino;
+    int64_t Off;
+    unsigned short Reclen;
+    unsigned char Type;
+    char Name[1];
+  };
+  PathDirs *Paths{&PathDirs::Shared()};
+  /* The build of the shared list Dirs was taken from. */
+  uint64_t List{0};
+  std::vector<Dir> Dirs;
+  /* Every command name, sorted and without duplicates. */
+  std::vector<std::string> Names;
+  bool Started{false};
+  std::thread Builder;
+  std::atomic<bool> Built{false};
+  std::vector<std::string> Found;
+
+  // Lists the executable files in a directory into 'names'.
+  static auto Scan(const std::string &path, std::vector<std::string> &names)
+      -> void {
+    names.clear();
+    int const fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+      return;
+    }
+    alignas(8) char buf[32768];
+    long n;
+    while ((n = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0) {
+      for (long pos = 0; pos < n;) {
+        auto const *ent = reinterpret_cast<const Dirent64 *>(buf + pos);
+        const char *name = buf + pos + offsetof(Dirent64, Name);
+        pos += ent->Reclen;
+        if (name[0] == '.' ||
+            (ent->Type != DT_REG && ent->Type != DT_LNK &&
+             ent->Type != DT_UNKNOWN)) {
+          continue;
+        }
+        struct stat st {};
+        if (fstatat(fd, name, &st, 0) == 0 && S_ISREG(st.st_mode) &&
+            (st.st_mode & 0111) != 0) {
+          names.emplace_back(name);
+        }
+      }
+    }
+    close(fd);
+  }
+  // Scans every directory, spreading them over as many threads as there are
+  // processors, and merges the results.
+  auto ScanAll() -> void {
+    std::atomic<size_t> next{0};
+    auto const work = [this, &next]() {
+      for (size_t i = next++; i < Dirs.size(); i = next++) {
+        Scan(Dirs[i].Path, Dirs[i].Names);
+      }
+    };
+    size_t const cores = std::thread::hardware_concurrency();
+    size_t const count = std::min(Dirs.size(), (cores > 0) ? cores : 1);
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < count; i++) {
+      threads.emplace_back(work);
+    }
+    work();
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    Merge();
+  }
+  auto Merge() -> void {
+    Names.clear();
+    for (auto const &dir : Dirs) {
+      Names.insert(Names.end(), dir.Names.begin(), dir.Names.end());
+    }
+    std::sort(Names.begin(), Names.end());
+    Names.erase(std::unique(Names.begin(), Names.end()), Names.end());
+  }
+  // Takes the absolute directories of the shared list, skipping any listed
+  // twice.
+  auto Watch() -> void {
+    Paths->Update();
+    List = Paths->GetList();
+    Dirs.clear();
+    auto const &dirs = Paths->GetDirs();
+    for (size_t i = 0; i < dirs.size(); i++) {
+      std::string const &path = dirs[i].Path;
+      if (dirs[i].Relative ||
+          std::any_of(Dirs.begin(), Dirs.end(),
+                      [&path](const Dir &d) { return d.Path == path; })) {
+        continue;
+      }
+      Dir entry;
+      entry.Path = path;
+      entry.Source = i;
+      entry.Seen = dirs[i].Changes;
+      Dirs.push_back(entry);
+    }
+  }
+  // Waits for the helper thread, starting it if need be, then rescans
+  // directories that changed since they were scanned, or have no watch, and
+  // rebuilds the index if $PATH changed.
+  auto Ready() -> void {
+    Start();
+    if (Builder.joinable()) {
+      Builder.join();
+    }
+    Paths->Update();
+    if (List != Paths->GetList()) {
+      Watch();
+      ScanAll();
+      return;
+    }
+    Paths->Poll();
+    bool changed = false;
+    for (auto &dir : Dirs) {
+      PathDirs::Dir const &shared = Paths->GetDirs()[dir.Source];
+      if (shared.Changes != dir.Seen || shared.Watch == -1) {
+        dir.Seen = shared.Changes;
+        Scan(dir.Path, dir.Names);
+        changed = true;
+      }
+    }
+    if (changed) {
+      Merge();
+    }
+  }
+  // Returns true if the word at 'start' in a line is in command position:
+  // first on the line or after a control operator.
+  static auto IsCommand(const std::string &line, size_t start) -> bool {
+    size_t i = start;
+    while (i > 0 && (line[i - 1] == ' ' || line[i - 1] == '\t')) {
+      i--;
+    }
+    return i == 0 || line[i - 1] == '|' || line[i - 1] == '&' ||
+           line[i - 1] == ';';
+  }
+  // Collects the entries of the directory part of 'word' that start with its
+  // last component, with a slash after directories.
+  auto FindPaths(const std::string &word) -> void {
+    size_t const slash = word.rfind('/');
+    std::string dir =
+        (slash == std::string::npos) ? "." : word.substr(0, slash + 1);
+    std::string const base =
+        (slash == std::string::npos) ? word : word.substr(slash + 1);
+    std::string const lead =
+        (slash == std::string::npos) ? "" : word.substr(0, slash + 1);
+    if (dir[0] == '~' && (dir.size() == 1 || dir[1] == '/')) {
+      const char *home = getenv("HOME");
+      dir = std::string(home != nullptr ? home : "") + dir.substr(1);
+    }
+    DIR *d = opendir(dir.c_str());
+    if (d == nullptr) {
+      return;
+    }
+    while (struct dirent *ent = readdir(d)) {
+      std::string const name = ent->d_name;
+      if (name == "." || name == ".." ||
+          (name[0] == '.' && (base.empty() || base[0] != '.')) ||
+          name.compare(0, base.size(), base) != 0) {
+        continue;
+      }
+      bool isdir = (ent->d_type == DT_DIR);
+      if (ent->d_type == DT_LNK || ent->d_type == DT_UNKNOWN) {
+        struct stat st {};
+        isdir = stat((dir + "/" + name).c_str(), &st) == 0 &&
+                S_ISDIR(st.st_mode);
+      }
+      Found.push_back(lead + name + (isdir ? "/" : ""));
+    }
+    closedir(d);
+  }
+
+public:
+  Completer() = default;
+  ~Completer() {
+    if (Builder.joinable()) {
+      Builder.join();
+    }
+  }
+  Completer(const Completer &) = delete;
+  auto operator=(const Completer &) -> Completer & = delete;
+  // Watches the $PATH directories and starts indexing them on the helper
+  // thread.
+  auto Start() -> void {
+    if (Started) {
+      return;
+    }
+    Started = true;
+    Watch();
+    Builder = std::thread([this]() {
+      ScanAll();
+      Built.store(true);
+    });
+  }
+  // Reads pending inotify events and rescans the directories they name. If
+  // the helper thread is still building the index the events are only
+  // counted, and the directories rescanned once it is done.
+  auto Refresh() -> void {
+    Paths->Poll();
+    if (Built.load()) {
+      Ready();
+    }
+  }
+  // Completes the last word of 'line' in place. A single candidate replaces
+  // the word, followed by a space unless it is a directory; several extend it
+  // to their longest common prefix. Returns the candidates when there are
+  // several and the word could not be extended, otherwise an empty list.
+  auto Complete(std::string &line) -> const std::vector<std::string> & {
+    Found.clear();
+    size_t start = line.size();
+    while (start > 0 && line[start - 1] != ' ' && line[start - 1] != '\t' &&
+           line[start - 1] != '|' && line[start - 1] != '&' &&
+           line[start - 1] != ';') {
+      start--;
+    }
+    std::string const word = line.substr(start);
+    if (IsCommand(line, start) && word.find('/') == std::string::npos) {
+      Ready();
+      for (auto const name : BuiltinNames) {
+        if (name.compare(0, word.size(), word) == 0) {
+          Found.emplace_back(name);
+        }
+      }
+      for (auto it = std::lower_bound(Names.begin(), Names.end(), word);
+           it != Names.end() && it->compare(0, word.size(), word) == 0;
+           ++it) {
+        Found.push_back(*it);
+      }
+    } else {
+      FindPaths(word);
+    }
+    std::sort(Found.begin(), Found.end());
+    Found.erase(std::unique(Found.begin(), Found.end()), Found.end());
+    if (Found.empty()) {
+      return Found;
+    }
+    if (Found.size() == 1) {
+      line.replace(start, std::string::npos, Found[0]);
+      if (Found[0].back() != '/') {
+        line += ' ';
+      }
+      Found.clear();
+      return Found;
+    }
+    size_t common = Found[0].size();
+    for (auto const &name : Found) {
+      size_t i = 0;
+      while (i < common && i < name.size() && name[i] == Found[0][i]) {
+        i++;
+      }
+      common = i;
+    }
+    if (common > word.size()) {
+      line.replace(start, std::string::npos, Found[0].substr(0, common));
+      Found.clear();
+    }
+    return Found;
+  }
+  // Returns the inotify descriptor, readable when a $PATH directory changed,
+  // or -1 if there is none.
+  auto GetFd() const -> int { return Paths->GetFd(); }
+};
+} // namespace Origin
+#endif // COMPLETE_HPP
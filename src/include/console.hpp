@@ -1,12 +1,24 @@
 #ifndef CON_HPP
 #define CON_HPP
+#include <cerrno>
+#include <csignal>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fcntl.h>
+#include <initializer_list>
+#include <poll.h>
 #include <sstream>
+#include <string>
 #include <stdio.h>
+#include <sys/ioctl.h>
 #include <termios.h>
 #include <unistd.h>
 
+/* Terminal output is not written as it is produced. Every method appends its
+escape sequences and text to one frame buffer, and Flush() hands the whole
+frame to the terminal in a single write(). Colour changes that would leave the
+terminal in the state it is already in are dropped. */
 struct Console {
   int Height;
   int Width;
@@ -18,18 +30,162 @@ struct Console {
                    LIGHTBLUE = 9, LIGHTGREEN = 10, LIGHTCYAN = 11,
                    LIGHTRED = 12, LIGHTMAGENTA = 13, YELLOW = 14, WHITE = 15,
                    BLINK = 128;
+  /* Set by the SIGWINCH handler installed by WatchResize() and cleared by
+  UpdateSize(). */
+  static inline volatile sig_atomic_t Resized = 1;
+  /* The terminal mode saved by EnableRawMode(), restored on exit. */
+  static inline struct termios Saved {};
+  static inline bool Raw = false;
+
+private:
+  /* Output of the current frame, written out by Flush(). */
+  std::string Out{};
+  /* The last SGR sequence written, kept across frames since the terminal
+  keeps it too. */
+  std::string Sgr{};
+
+  auto AppendInt(int n) -> void {
+    char digits[12];
+    int len = 0;
+    unsigned int u = (n < 0) ? 0u - static_cast<unsigned int>(n)
+                             : static_cast<unsigned int>(n);
+    do {
+      digits[len++] = static_cast<char>('0' + u % 10);
+      u /= 10;
+    } while (u != 0);
+    if (n < 0) {
+      Out += '-';
+    }
+    while (len > 0) {
+      Out += digits[--len];
+    }
+  }
+  // Appends a control sequence with the given parameters and final byte.
+  auto AppendCsi(std::initializer_list<int> params, char final) -> void {
+    Out += "\033[";
+    for (int const param : params) {
+      if (Out.back() != '[') {
+        Out += ';';
+      }
+      AppendInt(param);
+    }
+    Out += final;
+  }
+  // Appends an SGR sequence with the given parameters unless it is the one
+  // the terminal was last left in.
+  auto AppendSgr(std::initializer_list<int> params) -> void {
+    size_t const start = Out.size();
+    AppendCsi(params, 'm');
+    if (Out.compare(start, std::string::npos, Sgr) == 0) {
+      Out.resize(start);
+    } else {
+      Sgr.assign(Out, start, std::string::npos);
+    }
+  }
+
+public:
   Console() {
     Height = 25;
     Width = 80;
     BgColor = BLACK;
     FgColor = WHITE;
   }
-  inline auto ClearEOL() -> void { printf("\033[2K"); }
-  inline auto InsertLine() -> void { printf("\033[%dA", 1); }
-  inline auto GotoXY(int x, int y) { printf("\033[%d;%df", y, x); }
+  // Installs a SIGWINCH handler so size changes are picked up on the next
+  // frame instead of querying the terminal every time.
+  static auto WatchResize() -> void {
+    signal(SIGWINCH, [](int) { Resized = 1; });
+  }
+  inline auto IsResized() const -> bool { return Resized != 0; }
+  // Reads the terminal size into Width and Height. Returns false and keeps
+  // the previous size if stdout is not a terminal.
+  inline auto UpdateSize() -> bool {
+    struct winsize ws {};
+    Resized = 0;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != 0 || ws.ws_col == 0) {
+      return false;
+    }
+    Width = ws.ws_col;
+    Height = ws.ws_row;
+    return true;
+  }
+  // Switches stdin to non-canonical, no-echo mode once for the whole session,
+  // so keys can be read as they arrive without changing the mode around every
+  // read. Signal keys are delivered as plain bytes, so Ctrl-C and Ctrl-Z reach
+  // the shell's job control instead of stopping the shell. The original mode
+  // is restored by DisableRawMode() or at exit.
+  static auto EnableRawMode() -> bool {
+    if (Raw || tcgetattr(STDIN_FILENO, &Saved) != 0) {
+      return Raw;
+    }
+    struct termios raw = Saved;
+    raw.c_lflag &= ~(ICANON | ECHO | ISIG);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSANOW, &raw) != 0) {
+      return false;
+    }
+    static bool registered = false;
+    if (!registered) {
+      atexit([] { DisableRawMode(); });
+      registered = true;
+    }
+    Raw = true;
+    SetBracketedPaste(true);
+    return true;
+  }
+  static auto DisableRawMode() -> void {
+    if (Raw) {
+      SetBracketedPaste(false);
+      tcsetattr(STDIN_FILENO, TCSANOW, &Saved);
+      Raw = false;
+    }
+  }
+  // Asks the terminal to wrap pasted text in ESC[200~ and ESC[201~, or to
+  // stop doing so.
+  static auto SetBracketedPaste(bool on) -> bool {
+    const char *seq = on ? "\033[?2004h" : "\033[?2004l";
+    return write(STDOUT_FILENO, seq, strlen(seq)) > 0;
+  }
+  // Writes the frame buffer to the terminal in one call and empties it.
+  // Returns false if the terminal could not be written.
+  auto Flush() -> bool {
+    size_t done = 0;
+    while (done < Out.size()) {
+      ssize_t const n =
+          write(STDOUT_FILENO, Out.data() + done, Out.size() - done);
+      if (n > 0) {
+        done += static_cast<size_t>(n);
+      } else if (n < 0 && errno == EAGAIN) {
+        struct pollfd pfd {STDOUT_FILENO, POLLOUT, 0};
+        poll(&pfd, 1, -1);
+      } else if (n == 0 || errno != EINTR) {
+        break;
+      }
+    }
+    bool const ok = (done == Out.size());
+    Out.clear();
+    return ok;
+  }
+  // Returns the number of bytes waiting for the next Flush().
+  auto Pending() const -> size_t { return Out.size(); }
+  inline auto ClearEOL() -> void { Out += "\033[2K"; }
+  inline auto InsertLine() -> void { Out += "\033[1A"; }
+  inline auto GotoXY(int x, int y) {
+    AppendCsi({y, x}, 'f');
+  }
+
+  // Appends a complete SGR sequence, such as a cell's style, unless it is the
+  // one the terminal was last left in.
+  inline auto SetStyle(const std::string &sgr) -> void {
+    if (sgr != Sgr) {
+      Out += sgr;
+      Sgr = sgr;
+    }
+  }
 
   inline auto ClearScreen() -> void {
-    printf("\033[%dm\033[2J\033[1;1f", BgColor);
+    AppendSgr({BgColor});
+    Out += "\033[2J\033[1;1f";
   }
 
   inline auto SetBgColor(int color) -> void {
@@ -140,52 +296,52 @@ struct Console {
   inline auto PrintBgColor(int color) -> void {
     switch (color % 16) {
     case BLACK:
-      printf("\033[0;%d;%dm", 30, BgColor);
+      AppendSgr({0, 30, BgColor});
       break;
     case BLUE:
-      printf("\033[0;%d;%dm", 34, BgColor);
+      AppendSgr({0, 34, BgColor});
       break;
     case GREEN:
-      printf("\033[0;%d;%dm", 32, BgColor);
+      AppendSgr({0, 32, BgColor});
       break;
     case CYAN:
-      printf("\033[0;%d;%dm", 36, BgColor);
+      AppendSgr({0, 36, BgColor});
       break;
     case RED:
-      printf("\033[0;%d;%dm", 31, BgColor);
+      AppendSgr({0, 31, BgColor});
       break;
     case MAGENTA:
-      printf("\033[0;%d;%dm", 35, BgColor);
+      AppendSgr({0, 35, BgColor});
       break;
     case BROWN:
-      printf("\033[0;%d;%dm", 33, BgColor);
+      AppendSgr({0, 33, BgColor});
       break;
     case LIGHTGRAY:
-      printf("\033[0;%d;%dm", 37, BgColor);
+      AppendSgr({0, 37, BgColor});
       break;
     case DARKGRAY:
-      printf("\033[1;%d;%dm", 30, BgColor);
+      AppendSgr({1, 30, BgColor});
       break;
     case LIGHTBLUE:
-      printf("\033[1;%d;%dm", 34, BgColor);
+      AppendSgr({1, 34, BgColor});
       break;
     case LIGHTGREEN:
-      printf("\033[1;%d;%dm", 32, BgColor);
+      AppendSgr({1, 32, BgColor});
       break;
     case LIGHTCYAN:
-      printf("\033[1;%d;%dm", 36, BgColor);
+      AppendSgr({1, 36, BgColor});
       break;
     case LIGHTRED:
-      printf("\033[1;%d;%dm", 31, BgColor);
+      AppendSgr({1, 31, BgColor});
       break;
     case LIGHTMAGENTA:
-      printf("\033[1;%d;%dm", 35, BgColor);
+      AppendSgr({1, 35, BgColor});
       break;
     case YELLOW:
-      printf("\033[1;%d;%dm", 33, BgColor);
+      AppendSgr({1, 33, BgColor});
       break;
     case WHITE:
-      printf("\033[1;%d;%dm", 37, BgColor);
+      AppendSgr({1, 37, BgColor});
       break;
     default:
       break;
@@ -195,52 +351,52 @@ struct Console {
   inline auto PrintFgColor(int color) -> void {
     switch (color % 16) {
     case BLACK:
-      printf("\033[0;%d;%dm", 30, FgColor);
+      AppendSgr({0, 30, FgColor});
       break;
     case BLUE:
-      printf("\033[0;%d;%dm", 34, FgColor);
+      AppendSgr({0, 34, FgColor});
       break;
     case GREEN:
-      printf("\033[0;%d;%dm", 32, FgColor);
+      AppendSgr({0, 32, FgColor});
       break;
     case CYAN:
-      printf("\033[0;%d;%dm", 36, FgColor);
+      AppendSgr({0, 36, FgColor});
       break;
     case RED:
-      printf("\033[0;%d;%dm", 31, FgColor);
+      AppendSgr({0, 31, FgColor});
       break;
     case MAGENTA:
-      printf("\033[0;%d;%dm", 35, FgColor);
+      AppendSgr({0, 35, FgColor});
       break;
     case BROWN:
-      printf("\033[0;%d;%dm", 33, FgColor);
+      AppendSgr({0, 33, FgColor});
       break;
     case LIGHTGRAY:
-      printf("\033[0;%d;%dm", 37, FgColor);
+      AppendSgr({0, 37, FgColor});
       break;
     case DARKGRAY:
-      printf("\033[1;%d;%dm", 30, FgColor);
+      AppendSgr({1, 30, FgColor});
       break;
     case LIGHTBLUE:
-      printf("\033[1;%d;%dm", 34, FgColor);
+      AppendSgr({1, 34, FgColor});
       break;
     case LIGHTGREEN:
-      printf("\033[1;%d;%dm", 32, FgColor);
+      AppendSgr({1, 32, FgColor});
       break;
     case LIGHTCYAN:
-      printf("\033[1;%d;%dm", 36, FgColor);
+      AppendSgr({1, 36, FgColor});
       break;
     case LIGHTRED:
-      printf("\033[1;%d;%dm", 31, FgColor);
+      AppendSgr({1, 31, FgColor});
       break;
     case LIGHTMAGENTA:
-      printf("\033[1;%d;%dm", 35, FgColor);
+      AppendSgr({1, 35, FgColor});
       break;
     case YELLOW:
-      printf("\033[1;%d;%dm", 33, FgColor);
+      AppendSgr({1, 33, FgColor});
       break;
     case WHITE:
-      printf("\033[1;%d;%dm", 37, FgColor);
+      AppendSgr({1, 37, FgColor});
       break;
     default:
       break;
@@ -265,7 +421,8 @@ struct Console {
   }
 
   inline auto GetXY(int &x, int &y) -> int {
-    printf("\033[6n");
+    Out += "\033[6n";
+    Flush();
     if (GetChar() != '\x1B') {
       return 0;
     }
@@ -322,11 +479,15 @@ struct Console {
   }
 
   inline auto PrintChar(const char c) -> char {
-    printf("%c", c);
+    Out += c;
     return c;
   }
-  inline auto PrintStr(std::string str) -> int {
-    printf("%s", str.c_str());
+  inline auto PrintStr(const std::string &str) -> int {
+    Out += str;
+    return 0;
+  }
+  inline auto Print(const char *str, size_t len) -> int {
+    Out.append(str, len);
     return 0;
   }
   inline auto PrintStrColor(const std::string &str, int fg, int bg) -> int {
@@ -338,14 +499,14 @@ struct Console {
     return 0;
   }
   inline auto ChangeColor(int fg, int bg) -> int {
-    printf("\033[%d;%dm", fg + 30, bg + 40);
+    AppendSgr({fg + 30, bg + 40});
     return 0;
   }
   inline auto ChangeColor(int color) -> int {
     return ChangeColor(color % 16, color / 16);
   }
   inline auto PrintCStr(const char *str) -> int {
-    printf("%s", str);
+    Out += str;
     return 0;
   }
   auto GetHome() -> std::string { return GetEnv("HOME"); }
@@ -365,22 +526,25 @@ struct Console {
   }
   inline auto GetPass(const char *prompt) -> char * {
     char *pass = nullptr;
-    printf("%c", *prompt);
+    Out += *prompt;
+    Flush();
     return fgets(pass, 100, stdin);
   }
   inline auto GetEnv(const std::string &name) -> std::string {
-    return getenv(name.c_str());
+    const char *value = getenv(name.c_str());
+    return (value != nullptr) ? value : "";
   }
   inline auto ReadText(int l, int t, int r, int b, void *destination)
       -> size_t {
-    printf("\033[%d;%d;%d;%dH", b, t, r, l);
-    fflush(stdout);
+    AppendCsi({b, t, r, l}, 'H');
+    Flush();
     return fread(destination, 1, l * t * r, stdin);
   }
   inline auto WriteText(int l, int t, int r, int b, void *source) -> size_t {
-    printf("\033[%d;%d;%d;%dH", b, t, r, l);
-    fflush(stdout);
-    return fwrite(source, 1, l * t * r, stdout);
+    AppendCsi({b, t, r, l}, 'H');
+    size_t const len = static_cast<size_t>(l * t * r);
+    Out.append(static_cast<const char *>(source), len);
+    return Flush() ? len : 0;
   }
 };
 #endif
@@ -0,0 +1,206 @@
+#ifndef ENV_HPP
+#define ENV_HPP
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
+extern char **environ;
+namespace Origin {
+/* A set of NAME=value variables and the envp array handed to posix_spawn.
+Only exported variables go into envp; one set by an assignment is the shell's
+own until 'export' names it, while one already exported stays so.
+Copies share their variables until one of them changes, so a job can take a
+snapshot of the shell's environment for the price of a reference count. The
+envp array is kept with the variables and only rebuilt after a change, so
+spawning in a loop passes the same array every time. Shell() is the shell's
+own environment; it is read from environ once, all of it exported, and every
+change to its exported variables is also made to environ, so libc and the parts of the shell that call getenv() see
+it. The positional parameters of a script, $0 to $9, $# and $@, are kept
+with the variables. Copies of it are private, and none may be used from another thread, as
+whether variables are shared is judged by the reference count. */
+struct Environment {
+private:
+  struct Block {
+    /* Exported variables, then the shell's own. */
+    std::vector<std::string> Vars;
+    std::vector<std::string> Locals;
+    /* $0 and the script's arguments. */
+    std::vector<std::string> Params;
+    std::vector<char *> Envp;
+    bool Built{false};
+  };
+  std::shared_ptr<Block> Data{std::make_shared<Block>()};
+  bool Mirror{false};
+
+  // Returns the index of variable 'name' in 'vars', or vars.size().
+  static auto Find(const std::vector<std::string> &vars,
+                   std::string_view name) -> size_t {
+    size_t i = 0;
+    for (auto const &var : vars) {
+      if (var.size() > name.size() && var[name.size()] == '=' &&
+          var.compare(0, name.size(), name) == 0) {
+        return i;
+      }
+      i++;
+    }
+    return i;
+  }
+  // Returns the variables for changing, copying them first if they are
+  // shared. The envp array is rebuilt unless only the shell's own variables
+  // or the parameters are to change.
+  auto Own(bool exported = true) -> Block & {
+    if (Data.use_count() > 1) {
+      auto block = std::make_shared<Block>();
+      block->Vars = Data->Vars;
+      block->Locals = Data->Locals;
+      block->Params = Data->Params;
+      Data = std::move(block);
+    }
+    Data->Built = Data->Built && !exported;
+    return *Data;
+  }
+  // Sets variable 'i' of 'vars', or adds it when i is vars.size().
+  static auto Put(std::vector<std::string> &vars, size_t i,
+                  std::string_view name, std::string_view value) -> void {
+    std::string var;
+    var.reserve(name.size() + 1 + value.size());
+    var.append(name).append(1, '=').append(value);
+    if (i < vars.size()) {
+      vars[i] = std::move(var);
+    } else {
+      vars.push_back(std::move(var));
+    }
+  }
+  // Loads the process environment, to be kept in step with it.
+  explicit Environment(char **vars) : Mirror(true) {
+    for (; *vars != nullptr; vars++) {
+      if (strchr(*vars, '=') != nullptr) {
+        Data->Vars.emplace_back(*vars);
+      }
+    }
+  }
+
+public:
+  Environment() = default;
+  Environment(const Environment &other) : Data(other.Data) {}
+  auto operator=(const Environment &other) -> Environment & {
+    Data = other.Data;
+    Mirror = false;
+    return *this;
+  }
+  // Returns the shell's environment.
+  static auto Shell() -> Environment & {
+    static Environment shell(environ);
+    return shell;
+  }
+  // Returns the value of a variable, exported or not, or nullptr if it is not
+  // set.
+  auto Get(std::string_view name) const -> const char * {
+    size_t i = Find(Data->Vars, name);
+    if (i < Data->Vars.size()) {
+      return Data->Vars[i].c_str() + name.size() + 1;
+    }
+    i = Find(Data->Locals, name);
+    return (i < Data->Locals.size())
+               ? Data->Locals[i].c_str() + name.size() + 1
+               : nullptr;
+  }
+  // Sets a variable, which stays exported if it was and is otherwise the
+  // shell's own.
+  auto Set(std::string_view name, std::string_view value) -> void {
+    if (Find(Data->Vars, name) < Data->Vars.size()) {
+      Export(name, value);
+      return;
+    }
+    size_t const i = Find(Data->Locals, name);
+    if (i < Data->Locals.size() &&
+        Data->Locals[i].compare(name.size() + 1, std::string::npos, value) ==
+            0) {
+      return;
+    }
+    Put(Own(false).Locals, i, name, value);
+  }
+  // Sets a variable and exports it.
+  auto Export(std::string_view name, std::string_view value) -> void {
+    size_t const i = Find(Data->Vars, name);
+    if (i < Data->Vars.size() &&
+        Data->Vars[i].compare(name.size() + 1, std::string::npos, value) ==
+            0) {
+      return;
+    }
+    Block &block = Own();
+    size_t const local = Find(block.Locals, name);
+    if (local < block.Locals.size()) {
+      block.Locals.erase(block.Locals.begin() + static_cast<long>(local));
+    }
+    Put(block.Vars, i, name, value);
+    if (Mirror) {
+      setenv(std::string(name).c_str(), std::string(value).c_str(), 1);
+    }
+  }
+  // Exports a variable the shell has set, if it has.
+  auto Export(std::string_view name) -> void {
+    size_t const i = Find(Data->Locals, name);
+    if (i < Data->Locals.size()) {
+      std::string const value = Data->Locals[i].substr(name.size() + 1);
+      Export(name, value);
+    }
+  }
+  auto Unset(std::string_view name) -> void {
+    size_t i = Find(Data->Locals, name);
+    if (i < Data->Locals.size()) {
+      Block &block = Own(false);
+      block.Locals.erase(block.Locals.begin() + static_cast<long>(i));
+    }
+    i = Find(Data->Vars, name);
+    if (i == Data->Vars.size()) {
+      return;
+    }
+    Block &block = Own();
+    block.Vars.erase(block.Vars.begin() + static_cast<long>(i));
+    if (Mirror) {
+      unsetenv(std::string(name).c_str());
+    }
+  }
+  // Returns the positional parameters, $0 first, or nothing if none are set.
+  auto Params() const -> const std::vector<std::string> & {
+    return Data->Params;
+  }
+  // Sets $0 and the positional parameters after it.
+  auto SetParams(std::vector<std::string> params) -> void {
+    Own(false).Params = std::move(params);
+  }
+  // Returns every exported variable as NAME=value.
+  auto List() const -> const std::vector<std::string> & { return Data->Vars; }
+  // Returns the envp array, built on the first call after a change.
+  auto Envp() -> char ** {
+    Block &block = *Data;
+    if (!block.Built) {
+      block.Envp.clear();
+      for (auto &var : block.Vars) {
+        block.Envp.push_back(&var[0]);
+      }
+      block.Envp.push_back(nullptr);
+      block.Built = true;
+    }
+    return block.Envp.data();
+  }
+  // Returns true if 'name' can be a variable name.
+  static auto IsName(std::string_view name) -> bool {
+    if (name.empty() || (name[0] >= '0' && name[0] <= '9')) {
+      return false;
+    }
+    for (char const c : name) {
+      if (!(c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+            (c >= '0' && c <= '9'))) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+} // namespace Origin
+#endif // ENV_HPP
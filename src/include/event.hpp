@@ -0,0 +1,81 @@
+#ifndef EVENT_HPP
+#define EVENT_HPP
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+namespace Origin {
+using namespace std::chrono;
+/* Blocks the main loop until there is something to do. Descriptors are
+registered with a caller-chosen tag, and Wait() sleeps in epoll_wait until one
+of them is ready, returning the tags that fired. A timerfd provides a periodic
+tick for work that is not driven by a descriptor. */
+struct EventLoop {
+private:
+  int Epoll{-1};
+  int Tick{-1};
+  int Ready{0};
+  struct epoll_event Events[16];
+
+public:
+  /* Tag reported for the periodic tick. Caller tags must differ from it. */
+  static const uint32_t TickEvent = 0xffffffff;
+  EventLoop() {
+    Epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (Epoll == -1) {
+      throw std::runtime_error("epoll_create1() failed!");
+    }
+    Tick = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (Tick == -1) {
+      throw std::runtime_error("timerfd_create() failed!");
+    }
+    Add(Tick, TickEvent);
+  }
+  ~EventLoop() {
+    close(Tick);
+    close(Epoll);
+  }
+  EventLoop(const EventLoop &) = delete;
+  auto operator=(const EventLoop &) -> EventLoop & = delete;
+  // Watches fd for readability and reports it with the given tag.
+  auto Add(int fd, uint32_t tag) -> int {
+    struct epoll_event ev {};
+    ev.events = EPOLLIN;
+    ev.data.u32 = tag;
+    return epoll_ctl(Epoll, EPOLL_CTL_ADD, fd, &ev);
+  }
+  auto Remove(int fd) -> int {
+    return epoll_ctl(Epoll, EPOLL_CTL_DEL, fd, nullptr);
+  }
+  // Starts the periodic tick, or stops it when period is zero.
+  auto SetTick(nanoseconds period) -> int {
+    struct itimerspec spec {};
+    spec.it_interval.tv_sec = static_cast<time_t>(period.count() / 1000000000);
+    spec.it_interval.tv_nsec = static_cast<long>(period.count() % 1000000000);
+    spec.it_value = spec.it_interval;
+    return timerfd_settime(Tick, 0, &spec, nullptr);
+  }
+  // Sleeps until at least one descriptor is ready or timeout milliseconds
+  // pass (-1 waits forever). Returns the number of ready events.
+  auto Wait(int timeout = -1) -> int {
+    Ready = epoll_wait(Epoll, Events, 16, timeout);
+    if (Ready < 0) {
+      Ready = 0;
+    }
+    for (int i = 0; i < Ready; i++) {
+      if (Events[i].data.u32 == TickEvent) {
+        uint64_t expired = 0;
+        while (read(Tick, &expired, sizeof(expired)) > 0) {
+        }
+      }
+    }
+    return Ready;
+  }
+  // Returns the tag of the i'th event from the last Wait().
+  auto GetTag(int i) const -> uint32_t { return Events[i].data.u32; }
+  auto GetFd() const -> int { return Epoll; }
+};
+} // namespace Origin
+#endif // EVENT_HPP
@@ -0,0 +1,724 @@
+#ifndef EXEC_HPP
+#define EXEC_HPP
+#include "builtin.hpp"
+#include "env.hpp"
+#include "parser.hpp"
+#include "pathcache.hpp"
+#include "ring.hpp"
+#include "terminal.hpp"
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <spawn.h>
+#include <stdexcept>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+#include <vector>
+extern char **environ;
+namespace Origin {
+/* Runs a command line without blocking the caller. The line is parsed
+natively and every stage of a pipeline is started directly with posix_spawnp,
+its neighbours connected by pipes the shell never reads, so 'a | b | c' costs
+three processes rather than four. '&&', '||' and ';' are sequenced here: the
+next pipeline starts when the last stage of the current one has been reaped.
+A lone built-in runs in the shell itself, so 'cd dir && make' works. Each
+pipeline runs in a process group of its own so it can be stopped and continued
+as a unit. Lines using syntax the parser does not handle are passed whole to
+/bin/sh. posix_spawnp clones the shell without copying its address space
+(CLONE_VM | CLONE_VFORK in glibc), so starting a stage costs the same however
+large the shell grows, and the stages stay the shell's own children, which
+waitpid(), the process groups and job control depend on.
+Every stage's stderr and the final stage's stdout go to a pseudo-terminal
+sized like the output area, so programs see a terminal and keep their colours
+and line buffering, or to a pipe if no pty is available. Its non-blocking
+master is watched by an epoll instance, so output is streamed into a bounded
+ring buffer as it arrives instead of being collected in one string after the
+child exits. Output is also written to a terminal sink when one is set.
+An interactive executor, the one running the foreground job, also gives the
+pty to the first stage as its stdin, and a pipeline of one command starts in
+a session of its own with the pty as its controlling terminal, so full-screen
+programs get keystrokes through Input(), the window size and SIGWINCH, and
+the line discipline raises SIGINT and SIGTSTP for Ctrl-C and Ctrl-Z. The
+stages of a longer pipeline cannot share a session the shell did not create
+for them in one process group, so they keep a group of their own in the
+shell's session and read the pty without it being their controlling
+terminal. Otherwise children's stdin is /dev/null.
+In direct mode, used when the shell runs a script, there is no pty and no
+process group of the pipeline's own: commands read the shell's stdin and
+write straight to its stdout and stderr, as under any other shell. */
+struct Exec {
+private:
+  /* A redirection made ready by the shell: descriptor Fd of the command
+  becomes a copy of From, which is a file the shell opened when Own is set
+  and closes once the command has started. */
+  struct Opened {
+    int Fd;
+    int From;
+    bool Own;
+  };
+  /* Stages of the running pipeline, with -1 for those already reaped, and
+  the process group they share. */
+  std::vector<pid_t> Pids;
+  pid_t Group{0};
+  bool Stopped{false};
+  /* Read end of the output: a pty master, or a pipe. */
+  int Reader{-1};
+  /* Path of the pty's slave side, empty for a pipe. */
+  char Tty[64]{};
+  /* Set when the pipeline runs in a session whose controlling terminal is
+  the pty. */
+  bool Session{false};
+  bool Interactive{false};
+  bool Direct{false};
+  struct winsize Size {
+    24, 80, 0, 0
+  };
+  int Epoll{-1};
+  int Status{-1};
+  /* Status of the last finished pipeline, for '&&', '||' and $?. */
+  int Last{0};
+  Script Parsed;
+  size_t Next{0};
+  Ring Text;
+  Terminal *Sink{nullptr};
+  Builtins *Cmds{nullptr};
+  /* The environment commands see and change: the shell's, or a private
+  copy of it once Isolate() is called. */
+  Environment *Env{&Environment::Shell()};
+  Environment Local;
+  std::function<void(Script &)> Detach;
+  std::vector<std::string> Args;
+  /* NAME=value strings of the command being started. */
+  std::vector<std::string> Values;
+  /* Redirections of the command being started. */
+  std::vector<Opened> Redirs;
+  /* Descriptors the shell opens for redirections start here, clear of the
+  ones commands name. */
+  static const int FirstRedirFd = 10;
+  char Chunk[65536];
+  static const int MaxDrain = 16;
+
+  auto CloseReader() -> void {
+    if (Reader != -1) {
+      epoll_ctl(Epoll, EPOLL_CTL_DEL, Reader, nullptr);
+      close(Reader);
+      Reader = -1;
+    }
+    Tty[0] = '\0';
+  }
+  // Opens a pty, falling back to a pipe, whose read end is non-blocking and
+  // registered with epoll, replacing the previous pipeline's. Returns the
+  // write end.
+  auto OpenReader() -> int {
+    CloseReader();
+    int fds[2]{-1, -1};
+    fds[0] = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (fds[0] != -1 && grantpt(fds[0]) == 0 && unlockpt(fds[0]) == 0 &&
+        ptsname_r(fds[0], Tty, sizeof(Tty)) == 0) {
+      fds[1] = open(Tty, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    }
+    if (fds[1] != -1) {
+      ioctl(fds[0], TIOCSWINSZ, &Size);
+    } else {
+      Tty[0] = '\0';
+      if (fds[0] != -1) {
+        close(fds[0]);
+      }
+      if (pipe2(fds, O_CLOEXEC) != 0) {
+        throw std::runtime_error("pipe2() failed!");
+      }
+      fcntl(fds[0], F_SETPIPE_SZ, 1 << 20);
+    }
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    struct epoll_event ev {};
+    ev.events = EPOLLIN;
+    epoll_ctl(Epoll, EPOLL_CTL_ADD, fds[0], &ev);
+    Reader = fds[0];
+    return fds[1];
+  }
+  // Adds text of the shell's own, such as an error message, to the output.
+  auto Output(const std::string &text) -> void {
+    if (Direct) {
+      size_t done = 0;
+      while (done < text.size()) {
+        ssize_t const n =
+            write(STDERR_FILENO, text.data() + done, text.size() - done);
+        if (n <= 0 && errno != EINTR) {
+          break;
+        }
+        done += (n > 0) ? static_cast<size_t>(n) : 0;
+      }
+      return;
+    }
+    Text.Write(text.data(), text.size());
+    if (Sink != nullptr) {
+      Sink->Append(text);
+    }
+  }
+  // Reads what is currently available, at most 'limit' chunks so a command
+  // that never stops printing cannot starve the caller. Returns the number of
+  // bytes read, closing the reader once every child has closed its end, which
+  // a pty master reports as EIO rather than end of file.
+  auto Drain(int limit = MaxDrain) -> size_t {
+    size_t total = 0;
+    for (int i = 0; i < limit && Reader != -1; i++) {
+      ssize_t const n = read(Reader, Chunk, sizeof(Chunk));
+      if (n > 0) {
+        Text.Write(Chunk, static_cast<size_t>(n));
+        if (Sink != nullptr) {
+          Sink->Append(Chunk, static_cast<size_t>(n));
+        }
+        total += static_cast<size_t>(n);
+      } else if (n < 0 && errno == EINTR) {
+        continue;
+      } else {
+        if (n == 0 || errno != EAGAIN) {
+          CloseReader();
+        }
+        break;
+      }
+    }
+    return total;
+  }
+  // Builds the environment of a command with NAME=value assignments in front
+  // of it. Returns the cached envp of Env when there are none.
+  auto MakeEnv(const Command &cmd, std::vector<char *> &envp) -> char ** {
+    if (cmd.Assigns.empty()) {
+      return Env->Envp();
+    }
+    Values.clear();
+    std::vector<std::string> value;
+    for (auto const &assign : cmd.Assigns) {
+      size_t const eq = assign.find('=');
+      value.clear();
+      Parser::Expand(assign.substr(eq + 1), Last, *Env, value, false);
+      Values.push_back(assign.substr(0, eq + 1) + value[0]);
+    }
+    for (char **env = Env->Envp(); *env != nullptr; env++) {
+      const char *eq = strchr(*env, '=');
+      size_t const len = (eq != nullptr) ? size_t(eq - *env) + 1 : 0;
+      bool overridden = false;
+      for (size_t i = 0; i < cmd.Assigns.size() && !overridden; i++) {
+        overridden = Values[i].compare(0, len, *env, len) == 0;
+      }
+      if (!overridden) {
+        envp.push_back(*env);
+      }
+    }
+    for (auto &assign : Values) {
+      envp.push_back(&assign[0]);
+    }
+    envp.push_back(nullptr);
+    return envp.data();
+  }
+  // Opens the targets of a command's redirections in the shell, in order,
+  // into Redirs, so that a file that cannot be opened is reported as such
+  // rather than as a failure to start the command. Returns false, with
+  // nothing left open, if a target does not expand to exactly one word or
+  // cannot be opened, or a descriptor to copy is not open.
+  auto OpenRedirects(const Command &cmd) -> bool {
+    Redirs.clear();
+    std::vector<std::string> target;
+    for (auto const &r : cmd.Redirects) {
+      if (r.DupFd >= 0) {
+        bool known = fcntl(r.DupFd, F_GETFD) != -1;
+        for (auto const &done : Redirs) {
+          known = known || done.Fd == r.DupFd;
+        }
+        if (!known) {
+          Output("tshell: " + std::to_string(r.DupFd) +
+                 ": Bad file descriptor\n");
+          CloseRedirects();
+          return false;
+        }
+        Redirs.push_back({r.Fd, r.DupFd, false});
+        continue;
+      }
+      target.clear();
+      Parser::Expand(r.Target, Last, *Env, target);
+      if (target.size() != 1) {
+        Output("tshell: " + r.Target + ": ambiguous redirect\n");
+        CloseRedirects();
+        return false;
+      }
+      int fd = open(target[0].c_str(), r.Flags | O_CLOEXEC, 0666);
+      if (fd != -1 && fd < FirstRedirFd) {
+        int const moved = fcntl(fd, F_DUPFD_CLOEXEC, FirstRedirFd);
+        close(fd);
+        fd = moved;
+      }
+      if (fd == -1) {
+        Output("tshell: " + target[0] + ": " + strerror(errno) + "\n");
+        CloseRedirects();
+        return false;
+      }
+      bool const both = (r.Fd == -2);
+      Redirs.push_back({both ? STDOUT_FILENO : r.Fd, fd, true});
+      if (both) {
+        Redirs.push_back({STDERR_FILENO, STDOUT_FILENO, false});
+      }
+    }
+    return true;
+  }
+  // Closes the files opened for redirections.
+  auto CloseRedirects() -> void {
+    for (auto const &redir : Redirs) {
+      if (redir.Own) {
+        close(redir.From);
+      }
+    }
+    Redirs.clear();
+  }
+  // Returns the file to start for Args, which is the command's full path
+  // from the cache when it names no directory. A command given a $PATH of
+  // its own, or run with none set, is left for posix_spawnp to search.
+  auto Locate(const Command &cmd) -> const char * {
+    const char *path = Env->Get("PATH");
+    if (path == nullptr || Args[0].find('/') != std::string::npos) {
+      return Args[0].c_str();
+    }
+    for (auto const &assign : cmd.Assigns) {
+      if (assign.compare(0, 5, "PATH=") == 0) {
+        return Args[0].c_str();
+      }
+    }
+    const std::string *file = PathCache::Shared().Find(Args[0], path);
+    return (file != nullptr) ? file->c_str() : Args[0].c_str();
+  }
+  // Spawns Args as one stage reading from 'in', or when it is -1 from the pty
+  // of an interactive executor or /dev/null, and writing to 'out' and 'err'.
+  // Every stage joins the process group of the first, so the pipeline can be
+  // stopped, continued or interrupted as a whole, and starts with no signals
+  // blocked. In a session of its own, the stage opens the pty after setsid(),
+  // which makes it the controlling terminal. Returns the stage's exit status
+  // if it could not be started, 1 if a redirection failed, otherwise -1.
+  auto Spawn(const Command &cmd, int in, int out, int err) -> int {
+    if (!OpenRedirects(cmd)) {
+      return 1;
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (in == -1 && Interactive && Tty[0] != '\0') {
+      posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, Tty,
+                                       O_RDWR | (Session ? 0 : O_NOCTTY), 0);
+    } else if (in == -1 && !Direct) {
+      posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null",
+                                       O_RDONLY, 0);
+    } else if (in != -1) {
+      posix_spawn_file_actions_adddup2(&actions, in, STDIN_FILENO);
+    }
+    posix_spawn_file_actions_adddup2(&actions, out, STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, err, STDERR_FILENO);
+    std::vector<char *> envp;
+    char **env = MakeEnv(cmd, envp);
+    for (auto const &redir : Redirs) {
+      posix_spawn_file_actions_adddup2(&actions, redir.From, redir.Fd);
+    }
+    std::vector<char *> argv;
+    for (auto &arg : Args) {
+      argv.push_back(&arg[0]);
+    }
+    argv.push_back(nullptr);
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t none;
+    sigemptyset(&none);
+    posix_spawnattr_setsigmask(&attr, &none);
+    posix_spawnattr_setpgroup(&attr, Group);
+    short const group = Session  ? POSIX_SPAWN_SETSID
+                        : Direct ? 0
+                                 : POSIX_SPAWN_SETPGROUP;
+    posix_spawnattr_setflags(
+        &attr, static_cast<short>(POSIX_SPAWN_SETSIGMASK | group));
+    pid_t pid = -1;
+    int const rc =
+        posix_spawnp(&pid, Locate(cmd), &actions, &attr, argv.data(), env);
+    if (rc == ENOENT && strchr(argv[0], '/') == nullptr) {
+      Output("tshell: " + Args[0] + ": command not found\n");
+    } else if (rc != 0) {
+      Output("tshell: " + Args[0] + ": " + strerror(rc) + "\n");
+    }
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    CloseRedirects();
+    if (rc != 0) {
+      return (rc == ENOENT) ? 127 : 126;
+    }
+    if (Group == 0 && !Direct) {
+      Group = pid;
+    }
+    Pids.push_back(pid);
+    return -1;
+  }
+  // Starts every stage of a pipeline. Returns false if nothing was started.
+  auto Start(const Pipeline &pipeline) -> bool {
+    int const out = Direct ? STDOUT_FILENO : OpenReader();
+    int const err = Direct ? STDERR_FILENO : out;
+    Group = 0;
+    Stopped = false;
+    size_t const count = pipeline.Commands.size();
+    Session = Interactive && Tty[0] != '\0' && count == 1;
+    int in = -1;
+    int failed = -1;
+    for (size_t i = 0; i < count; i++) {
+      int link[2]{-1, -1};
+      if (i + 1 < count && pipe2(link, O_CLOEXEC) != 0) {
+        throw std::runtime_error("pipe2() failed!");
+      }
+      const Command &cmd = pipeline.Commands[i];
+      Args.clear();
+      if (Parsed.Fallback) {
+        // /bin/sh gets the positional parameters too, $0 first.
+        Args = {"/bin/sh", "-c", cmd.Words[0]};
+        Args.insert(Args.end(), Env->Params().begin(), Env->Params().end());
+      } else {
+        for (auto const &word : cmd.Words) {
+          Parser::Expand(word, Last, *Env, Args);
+        }
+      }
+      failed = Args.empty()
+                   ? 0
+                   : Spawn(cmd, in, (i + 1 < count) ? link[1] : out, err);
+      if (in != -1) {
+        close(in);
+      }
+      if (link[1] != -1) {
+        close(link[1]);
+      }
+      in = link[0];
+    }
+    if (!Direct) {
+      close(out);
+    }
+    if (Pids.empty()) {
+      Status = (failed >= 0) ? failed : 0;
+      return false;
+    }
+    // A last stage that failed to start decides the pipeline's status even
+    // though earlier stages are still running.
+    if (failed >= 0) {
+      Pids.push_back(-1);
+      Status = failed;
+    }
+    return true;
+  }
+  // Runs a pipeline that is a lone built-in, or a lone list of assignments,
+  // in the shell itself, with its redirections applied to what it prints.
+  // Returns false if it is neither.
+  auto RunHere(const Pipeline &pipeline) -> bool {
+    if (pipeline.Commands.size() != 1 || Parsed.Fallback) {
+      return false;
+    }
+    const Command &cmd = pipeline.Commands[0];
+    Args.clear();
+    for (auto const &word : cmd.Words) {
+      Parser::Expand(word, Last, *Env, Args);
+    }
+    if (Args.empty() && !OpenRedirects(cmd)) {
+      Status = 1;
+      return true;
+    }
+    if (Args.empty()) {
+      // Without a command, redirections only create their files.
+      CloseRedirects();
+    }
+    if (Args.empty() && !cmd.Words.empty()) {
+      Status = 0;
+      return true;
+    }
+    if (Args.empty()) {
+      // Without a command, assignments set shell variables, which commands
+      // only see once they are exported.
+      std::vector<char *> envp;
+      MakeEnv(cmd, envp);
+      for (auto const &assign : Values) {
+        size_t const eq = assign.find('=');
+        Env->Set(std::string_view(assign).substr(0, eq),
+                 std::string_view(assign).substr(eq + 1));
+      }
+      Status = 0;
+      return true;
+    }
+    if (Cmds == nullptr || !Cmds->Has(Args[0])) {
+      return false;
+    }
+    // Redirections send what the built-in prints to the files opened for
+    // them; descriptors other than stdout and stderr are only opened.
+    if (!OpenRedirects(cmd)) {
+      Status = 1;
+      return true;
+    }
+    for (auto const &redir : Redirs) {
+      if (redir.Own) {
+        Cmds->Redirect(redir.Fd, redir.From);
+      } else {
+        Cmds->Duplicate(redir.Fd, redir.From);
+      }
+    }
+    Status = Cmds->Run(Args);
+    Cmds->Restore();
+    CloseRedirects();
+    return true;
+  }
+  // Starts the next pipeline whose condition holds, running built-ins inline,
+  // until one is left running or the line is finished. An and-or list ended
+  // by '&' is handed to the detach hook, when one is set, to run as a job of
+  // its own while the line carries on.
+  auto Advance() -> void {
+    while (Pids.empty() && Next < Parsed.Pipelines.size()) {
+      const Pipeline &pipeline = Parsed.Pipelines[Next++];
+      size_t end = Next - 1;
+      while (pipeline.When == Pipeline::Always &&
+             end + 1 < Parsed.Pipelines.size() &&
+             Parsed.Pipelines[end + 1].When != Pipeline::Always) {
+        end++;
+      }
+      if (pipeline.When == Pipeline::Always &&
+          Parsed.Pipelines[end].Background && Detach) {
+        Script job;
+        job.Pipelines.assign(Parsed.Pipelines.begin() + long(Next - 1),
+                             Parsed.Pipelines.begin() + long(end + 1));
+        job.Pipelines.back().Background = false;
+        Next = end + 1;
+        Detach(job);
+        Last = 0;
+        continue;
+      }
+      if ((pipeline.When == Pipeline::IfSuccess && Last != 0) ||
+          (pipeline.When == Pipeline::IfFailure && Last == 0)) {
+        continue;
+      }
+      Status = -1;
+      if (!RunHere(pipeline) && Start(pipeline)) {
+        return;
+      }
+      Last = Status;
+    }
+  }
+
+public:
+  Exec(size_t capacity = 1 << 20) : Text(capacity) {
+    Epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (Epoll == -1) {
+      throw std::runtime_error("epoll_create1() failed!");
+    }
+  }
+  ~Exec() {
+    for (pid_t const pid : Pids) {
+      if (pid > 0) {
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+      }
+    }
+    CloseReader();
+    close(Epoll);
+  }
+  Exec(const Exec &) = delete;
+  auto operator=(const Exec &) -> Exec & = delete;
+  // Collects the status of every stage that exited, stopped or continued,
+  // without waiting unless 'block' is set. Once the whole pipeline has
+  // exited, reads what it left in the pipes and starts the next one. Called
+  // on SIGCHLD and by Poll().
+  auto Reap(bool block = false) -> void {
+    bool done = true;
+    int const flags = block ? 0 : WNOHANG | WUNTRACED | WCONTINUED;
+    for (size_t i = 0; i < Pids.size(); i++) {
+      int status = 0;
+      if (Pids[i] > 0 && waitpid(Pids[i], &status, flags) == Pids[i]) {
+        if (WIFSTOPPED(status) || WIFCONTINUED(status)) {
+          Stopped = WIFSTOPPED(status);
+          done = false;
+          continue;
+        }
+        Pids[i] = -1;
+        if (i + 1 == Pids.size()) {
+          Status = WIFEXITED(status) ? WEXITSTATUS(status)
+                                     : 128 + WTERMSIG(status);
+          // A pipeline interrupted from the keyboard ends the line, as the
+          // shell itself would have been interrupted.
+          if (WIFSIGNALED(status) && WTERMSIG(status) == SIGINT) {
+            Cancel();
+          }
+        }
+      }
+      done = done && Pids[i] == -1;
+    }
+    if (!done || Pids.empty()) {
+      return;
+    }
+    // Anything still holding the output open outlived the pipeline, so only
+    // what is buffered now is kept: one pass takes more than a pipe or pty
+    // can hold, and a descendant that keeps writing cannot hold the caller.
+    Drain();
+    CloseReader();
+    Pids.clear();
+    Stopped = false;
+    Last = Status;
+    Advance();
+  }
+  // Returns true if every pipeline of a parsed line is a lone built-in or a
+  // list of assignments, so that running it starts no process.
+  auto IsInline(const Script &script) -> bool {
+    if (script.Fallback) {
+      return false;
+    }
+    std::vector<std::string> first;
+    for (auto const &pipeline : script.Pipelines) {
+      if (pipeline.Background || pipeline.Commands.size() != 1) {
+        return false;
+      }
+      const Command &cmd = pipeline.Commands[0];
+      if (cmd.Words.empty()) {
+        continue;
+      }
+      first.clear();
+      Parser::Expand(cmd.Words[0], Last, *Env, first);
+      if (first.empty() || Cmds == nullptr || !Cmds->Has(first[0])) {
+        return false;
+      }
+    }
+    return true;
+  }
+  // Parses a command line and starts it, returning immediately. Returns -1 if
+  // a command is still running.
+  auto Run(const std::string &line) -> int {
+    if (IsRunning()) {
+      return -1;
+    }
+    Script script;
+    if (!Parser::Parse(line, script)) {
+      Text.Clear();
+      Output("tshell: syntax error: " + script.Error + "\n");
+      Status = Last = 2;
+      return 0;
+    }
+    if (script.Fallback) {
+      script.Pipelines.assign(1, Pipeline{});
+      script.Pipelines[0].Commands.resize(1);
+      script.Pipelines[0].Commands[0].Words.assign(1, line);
+      script.Pipelines[0].Text = line;
+    }
+    return Run(std::move(script));
+  }
+  // Starts an already parsed script. Returns -1 if a command is still running.
+  auto Run(Script script) -> int {
+    if (IsRunning()) {
+      return -1;
+    }
+    Text.Clear();
+    Status = -1;
+    Parsed = std::move(script);
+    Next = 0;
+    Advance();
+    return 0;
+  }
+  // Waits up to timeout milliseconds for output and moves whatever is ready
+  // into the ring buffer. Returns the number of bytes read.
+  auto Poll(int timeout = 0) -> size_t {
+    struct epoll_event event;
+    size_t total = 0;
+    if (Reader != -1 && epoll_wait(Epoll, &event, 1, timeout) > 0) {
+      total += Drain();
+    }
+    Reap();
+    return total;
+  }
+  // Blocks until the line has run to its end.
+  auto Finish() -> void {
+    while (IsRunning()) {
+      Reap(true);
+    }
+  }
+  // Sends a signal to the process group of the running pipeline.
+  auto Kill(int sig = SIGTERM) -> int {
+    return (IsRunning() && Group > 0) ? kill(-Group, sig) : -1;
+  }
+  // Drops the pipelines of the line that have not started yet, as after an
+  // interrupt.
+  auto Cancel() -> void { Next = Parsed.Pipelines.size(); }
+  auto IsRunning() const -> bool { return !Pids.empty(); }
+  // Returns true while the running pipeline is stopped by a signal.
+  auto IsStopped() const -> bool { return IsRunning() && Stopped; }
+  // Returns the exit status of the last pipeline, or -1 while it is running.
+  auto GetStatus() const -> int { return IsRunning() ? -1 : Status; }
+  // Returns the status of the last pipeline that finished, as $? sees it.
+  auto GetLast() const -> int { return Last; }
+  // Returns the process id of the last running stage, or -1.
+  auto GetPid() const -> pid_t {
+    for (size_t i = Pids.size(); i > 0; i--) {
+      if (Pids[i - 1] > 0) {
+        return Pids[i - 1];
+      }
+    }
+    return -1;
+  }
+  // Writes keystrokes to the pty the running pipeline reads. Returns false if
+  // it reads none, or the pty's input queue is full.
+  auto Input(const char *data, size_t size) -> bool {
+    if (!IsRunning() || !Interactive || Tty[0] == '\0') {
+      return false;
+    }
+    while (size > 0) {
+      ssize_t const n = write(Reader, data, size);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        return false;
+      }
+      data += n;
+      size -= static_cast<size_t>(n);
+    }
+    return true;
+  }
+  // Returns true if the pipeline reads a pty that is its controlling
+  // terminal, so Ctrl-C and Ctrl-Z can be sent to it as keystrokes.
+  auto IsSession() const -> bool {
+    return IsRunning() && Session && Reader != -1;
+  }
+  // Returns true if the pipeline reads a pty it has put in non-canonical
+  // mode, as full-screen programs do, so every key should go to it as typed.
+  auto IsRaw() const -> bool {
+    struct termios mode {};
+    return IsRunning() && Interactive && Tty[0] != '\0' &&
+           tcgetattr(Reader, &mode) == 0 && (mode.c_lflag & ICANON) == 0;
+  }
+  // Returns the epoll descriptor, which becomes readable when output arrives.
+  auto GetFd() const -> int { return Epoll; }
+  auto GetText() -> Ring & { return Text; }
+  // Sets whether the commands read the pty, as the foreground job does.
+  auto SetInteractive(bool interactive) -> void { Interactive = interactive; }
+  // Sets whether commands use the shell's own stdin, stdout and stderr.
+  auto SetDirect(bool direct) -> void { Direct = direct; }
+  // Sets a terminal that receives a copy of all output, or nullptr.
+  auto SetSink(Terminal *sink) -> void { Sink = sink; }
+  // Sets the size of the terminal commands see, including the one running.
+  auto SetSize(int cols, int rows) -> void {
+    Size.ws_col = static_cast<unsigned short>(cols);
+    Size.ws_row = static_cast<unsigned short>(rows);
+    if (Reader != -1) {
+      ioctl(Reader, TIOCSWINSZ, &Size);
+    }
+  }
+  // Sets the built-ins run in the shell when they make up a whole pipeline.
+  auto SetBuiltins(Builtins *cmds) -> void { Cmds = cmds; }
+  // Gives the commands a private copy of the environment as it is now, as
+  // for a background job, so neither sees the other's later changes.
+  auto Isolate() -> void {
+    Local = *Env;
+    Env = &Local;
+  }
+  // Sets the hook that takes and-or lists ended by '&' to run elsewhere.
+  auto SetDetach(std::function<void(Script &)> detach) -> void {
+    Detach = std::move(detach);
+  }
+};
+} // namespace Origin
+#endif // EXEC_HPP
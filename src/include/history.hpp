@@ -0,0 +1,390 @@
+#ifndef HISTORY_HPP
+#define HISTORY_HPP
+#include "timer.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <string_view>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+namespace Origin {
+/* Every command line entered, kept in an append-only file of newline-ended
+entries that is mapped into memory and written through the mapping. A newline
+within an entry, from a pasted multi-line command, is stored as Escape followed
+by 'n', and Escape itself is doubled. The file grows in steps and its unused
+tail is zeros, so after a crash the end of the log is found by scanning back
+over the zeros, and a torn final entry is recognised by its missing newline and
+dropped. Writes are made durable in batches by Sync(). Opening only maps the
+file; the indexes are built by a helper thread started by Start(), or by the
+first lookup that needs them. Entries are numbered from 0, oldest first. Prefix
+lookups binary search an array of entries sorted by text, and substring lookups
+walk the posting list of the query's rarest trigram, so neither reads more than
+a small part of the log. Several shells can share the file: appends take an
+exclusive lock and first pick up entries other shells wrote. If the file cannot
+be opened the log is kept in anonymous memory. */
+struct History {
+private:
+  /* Address space reserved for the mapping; the file may not grow past it. */
+  static constexpr size_t MapLimit = size_t(1) << 32;
+  static constexpr size_t GrowStep = 1 << 16;
+  static constexpr int SyncBatch = 64;
+  static constexpr nanoseconds SyncInterval = seconds(1);
+  /* Starts an escaped newline or Escape byte within a stored entry; 0x1f, the
+  ASCII unit separator, is not typed, so older logs read the same. */
+  static constexpr char Escape = '\x1f';
+  int File{-1};
+  char *Map{nullptr};
+  /* Bytes of the file that are mapped, and the end of the last entry. */
+  size_t Capacity{0};
+  size_t End{0};
+  /* Entries appended since the last Sync(), and where the unsynced ones
+  start. */
+  int Unsynced{0};
+  size_t SyncedTo{0};
+  nanoseconds LastSync{nanoseconds::zero()};
+  /* Start offset of every indexed entry, entry numbers sorted by text and
+  then number, and for each trigram the entries containing it in order. */
+  std::vector<uint32_t> Starts;
+  std::vector<uint32_t> Sorted;
+  std::unordered_map<uint32_t, std::vector<uint32_t>> Trigrams;
+  /* Offset up to which entries are indexed. */
+  size_t Indexed{0};
+  bool Started{false};
+  std::thread Builder;
+
+  static auto Key(const char *s) -> uint32_t {
+    return static_cast<uint32_t>(static_cast<unsigned char>(s[0])) << 16 |
+           static_cast<uint32_t>(static_cast<unsigned char>(s[1])) << 8 |
+           static_cast<uint32_t>(static_cast<unsigned char>(s[2]));
+  }
+  auto Open(const std::string &path) -> void {
+    File = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    struct stat st {};
+    if (File != -1 && fstat(File, &st) == 0 &&
+        static_cast<size_t>(st.st_size) <= MapLimit) {
+      void *map = mmap(nullptr, MapLimit, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_NORESERVE, File, 0);
+      if (map != MAP_FAILED) {
+        Map = static_cast<char *>(map);
+        Capacity = static_cast<size_t>(st.st_size);
+        return;
+      }
+    }
+    if (File != -1) {
+      close(File);
+      File = -1;
+    }
+    void *map = mmap(nullptr, MapLimit, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    Map = (map != MAP_FAILED) ? static_cast<char *>(map) : nullptr;
+    Capacity = (Map != nullptr) ? MapLimit : 0;
+  }
+  // Returns the offset of the first zero byte at or after 'from', where the
+  // unused tail begins.
+  auto FindZero(size_t from) const -> size_t {
+    const void *zero = memchr(Map + from, 0, Capacity - from);
+    return (zero != nullptr)
+               ? static_cast<size_t>(static_cast<const char *>(zero) - Map)
+               : Capacity;
+  }
+  // Returns the end of the last complete entry at or after 'from'; anything
+  // after the last newline before the unused tail is a torn entry.
+  auto FindEnd(size_t from) const -> size_t {
+    size_t end = FindZero(from);
+    while (end > from && Map[end - 1] != '\n') {
+      end--;
+    }
+    return end;
+  }
+  // Returns the end of the last complete entry, found by searching back from
+  // the end of the file. The file grows by GrowStep, so the unused tail is
+  // shorter than that and opening reads none of the log before it.
+  auto FindLast() const -> size_t {
+    size_t end = Capacity;
+    while (end > 0 && Map[end - 1] == '\0') {
+      end--;
+    }
+    while (end > 0 && Map[end - 1] != '\n') {
+      end--;
+    }
+    return end;
+  }
+  // Returns text as stored in the log, with newlines and Escape escaped.
+  static auto Encode(std::string_view text) -> std::string {
+    std::string out;
+    out.reserve(text.size());
+    for (char const c : text) {
+      if (c == '\n' || c == Escape) {
+        out += Escape;
+      }
+      out += (c == '\n') ? 'n' : c;
+    }
+    return out;
+  }
+  // Returns the text of an entry as stored, without its newline.
+  auto Stored(size_t id) const -> std::string_view {
+    size_t const start = Starts[id];
+    size_t const end = (id + 1 < Starts.size()) ? Starts[id + 1] : Indexed;
+    return std::string_view(Map + start, end - start - 1);
+  }
+  // Indexes the entries in [Indexed, end). Sorted is rebuilt with one sort
+  // when many entries arrive at once and kept sorted by insertion otherwise.
+  auto Index(size_t end) -> void {
+    size_t const first = Starts.size();
+    for (size_t at = Indexed; at < end;) {
+      const char *nl =
+          static_cast<const char *>(memchr(Map + at, '\n', end - at));
+      size_t const next = static_cast<size_t>(nl - Map) + 1;
+      uint32_t const id = static_cast<uint32_t>(Starts.size());
+      Starts.push_back(static_cast<uint32_t>(at));
+      for (size_t i = at; i + 3 < next; i++) {
+        std::vector<uint32_t> &posting = Trigrams[Key(Map + i)];
+        if (posting.empty() || posting.back() != id) {
+          posting.push_back(id);
+        }
+      }
+      at = next;
+    }
+    Indexed = end;
+    auto const less = [this](uint32_t a, uint32_t b) {
+      int const c = Stored(a).compare(Stored(b));
+      return c < 0 || (c == 0 && a < b);
+    };
+    if (Starts.size() - first > 16) {
+      for (size_t id = first; id < Starts.size(); id++) {
+        Sorted.push_back(static_cast<uint32_t>(id));
+      }
+      std::sort(Sorted.begin(), Sorted.end(), less);
+      return;
+    }
+    for (size_t id = first; id < Starts.size(); id++) {
+      uint32_t const n = static_cast<uint32_t>(id);
+      Sorted.insert(std::upper_bound(Sorted.begin(), Sorted.end(), n, less),
+                    n);
+    }
+  }
+  // Waits for the helper thread, then indexes entries not indexed yet, all
+  // of them if it was never started.
+  auto Ready() -> void {
+    Started = true;
+    if (Builder.joinable()) {
+      Builder.join();
+    }
+    if (Indexed < End) {
+      Index(End);
+    }
+  }
+
+public:
+  // Opens the log at 'path', or at $TSHELL_HISTORY or ~/.tshell_history when
+  // it is empty.
+  History(std::string path = "") {
+    if (path.empty()) {
+      const char *env = getenv("TSHELL_HISTORY");
+      const char *home = getenv("HOME");
+      path = (env != nullptr && *env != '\0')
+                 ? env
+                 : std::string(home != nullptr ? home : ".") +
+                       "/.tshell_history";
+    }
+    Open(path);
+    if (Map == nullptr) {
+      return;
+    }
+    End = (File != -1) ? FindLast() : 0;
+    SyncedTo = End;
+    LastSync = Timer::GetNow();
+  }
+  ~History() {
+    if (Builder.joinable()) {
+      Builder.join();
+    }
+    Sync(true);
+    if (Map != nullptr) {
+      munmap(Map, MapLimit);
+    }
+    if (File != -1) {
+      close(File);
+    }
+  }
+  History(const History &) = delete;
+  auto operator=(const History &) -> History & = delete;
+  // Starts indexing the entries found at open on the helper thread.
+  auto Start() -> void {
+    if (Started || Map == nullptr) {
+      return;
+    }
+    Started = true;
+    size_t const end = End;
+    Builder = std::thread([this, end]() { Index(end); });
+  }
+  // Appends an entry unless it is empty, holds a NUL or repeats the newest
+  // entry. Returns false if it was not added.
+  auto Add(std::string_view text) -> bool {
+    if (Map == nullptr || text.empty() ||
+        text.find('\0') != std::string_view::npos) {
+      return false;
+    }
+    std::string const line = Encode(text);
+    if (File != -1) {
+      flock(File, LOCK_EX);
+      struct stat st {};
+      if (fstat(File, &st) == 0 &&
+          static_cast<size_t>(st.st_size) > Capacity &&
+          static_cast<size_t>(st.st_size) <= MapLimit) {
+        Capacity = static_cast<size_t>(st.st_size);
+      }
+      End = FindEnd(End);
+    }
+    size_t last = End;
+    while (last > 0 && (last == End || Map[last - 1] != '\n')) {
+      last--;
+    }
+    bool const repeat = End > 0 && End - last - 1 == line.size() &&
+                        memcmp(Map + last, line.data(), line.size()) == 0;
+    size_t const need = End + line.size() + 1;
+    if (!repeat && need > Capacity && File != -1) {
+      size_t const size = (need + GrowStep - 1) / GrowStep * GrowStep;
+      if (size <= MapLimit && ftruncate(File, static_cast<off_t>(size)) == 0) {
+        Capacity = size;
+      }
+    }
+    bool const added = !repeat && need <= Capacity;
+    if (added) {
+      // Clear what a torn entry left past the end before writing over it.
+      size_t const dirty = FindZero(End);
+      memcpy(Map + End, line.data(), line.size());
+      Map[need - 1] = '\n';
+      if (dirty > need) {
+        memset(Map + need, 0, dirty - need);
+      }
+      End = need;
+      Unsynced++;
+    }
+    if (File != -1) {
+      flock(File, LOCK_UN);
+    }
+    if (Started && !Builder.joinable() && added) {
+      Index(End);
+    }
+    return added;
+  }
+  // Makes appended entries durable once enough have gathered or enough time
+  // has passed since the last sync, or at once with 'force'.
+  auto Sync(bool force = false) -> void {
+    if (Unsynced == 0 || File == -1) {
+      return;
+    }
+    nanoseconds const now = Timer::GetNow();
+    if (!force && Unsynced < SyncBatch && now - LastSync < SyncInterval) {
+      return;
+    }
+    size_t const page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t const from = SyncedTo / page * page;
+    msync(Map + from, End - from, MS_SYNC);
+    SyncedTo = End;
+    Unsynced = 0;
+    LastSync = now;
+  }
+  // Returns the number of entries.
+  auto Count() -> size_t {
+    Ready();
+    return Starts.size();
+  }
+  // Returns the text of an entry, with its newlines restored.
+  auto Get(size_t id) const -> std::string {
+    std::string_view const stored = Stored(id);
+    std::string out;
+    out.reserve(stored.size());
+    for (size_t i = 0; i < stored.size(); i++) {
+      if (stored[i] == Escape && i + 1 < stored.size()) {
+        i++;
+        out += (stored[i] == 'n') ? '\n' : stored[i];
+      } else {
+        out += stored[i];
+      }
+    }
+    return out;
+  }
+  // Returns the nearest entry before 'from', or after it when 'older' is
+  // false, that starts with 'prefix' and differs from 'skip', or -1.
+  auto Step(std::string_view prefix, long from, bool older,
+            std::string_view skip) -> long {
+    Ready();
+    std::string const want = Encode(prefix);
+    std::string const avoid = Encode(skip);
+    long const count = static_cast<long>(Starts.size());
+    if (want.empty()) {
+      for (long id = older ? from - 1 : from + 1; id >= 0 && id < count;
+           id += older ? -1 : 1) {
+        if (Stored(static_cast<size_t>(id)) != avoid) {
+          return id;
+        }
+      }
+      return -1;
+    }
+    auto const lo = std::lower_bound(
+        Sorted.begin(), Sorted.end(), want,
+        [this](uint32_t id, std::string_view p) { return Stored(id) < p; });
+    long best = -1;
+    for (auto it = lo; it != Sorted.end(); ++it) {
+      std::string_view const text = Stored(*it);
+      if (text.compare(0, want.size(), want) != 0) {
+        break;
+      }
+      long const id = static_cast<long>(*it);
+      if (text != avoid && (older ? id < from && id > best
+                                  : id > from && (best < 0 || id < best))) {
+        best = id;
+      }
+    }
+    return best;
+  }
+  // Returns the newest entry before 'from' that contains 'query' and differs
+  // from 'skip', or -1.
+  auto Search(std::string_view query, long from, std::string_view skip)
+      -> long {
+    Ready();
+    std::string const want = Encode(query);
+    std::string const avoid = Encode(skip);
+    if (want.size() < 3) {
+      for (long id = from - 1; id >= 0; id--) {
+        std::string_view const stored = Stored(static_cast<size_t>(id));
+        if (stored.find(want) != std::string_view::npos && stored != avoid) {
+          return id;
+        }
+      }
+      return -1;
+    }
+    const std::vector<uint32_t> *rarest = nullptr;
+    for (size_t i = 0; i + 3 <= want.size(); i++) {
+      auto const it = Trigrams.find(Key(want.data() + i));
+      if (it == Trigrams.end()) {
+        return -1;
+      }
+      if (rarest == nullptr || it->second.size() < rarest->size()) {
+        rarest = &it->second;
+      }
+    }
+    auto it = std::lower_bound(rarest->begin(), rarest->end(),
+                               static_cast<uint32_t>(from));
+    while (it != rarest->begin()) {
+      --it;
+      std::string_view const stored = Stored(*it);
+      if (stored.find(want) != std::string_view::npos && stored != avoid) {
+        return static_cast<long>(*it);
+      }
+    }
+    return -1;
+  }
+};
+} // namespace Origin
+#endif // HISTORY_HPP
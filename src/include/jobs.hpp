@@ -0,0 +1,494 @@
+#ifndef JOBS_HPP
+#define JOBS_HPP
+#include "builtin.hpp"
+#include "exec.hpp"
+#include "parser.hpp"
+#include "terminal.hpp"
+#include <csignal>
+#include <cstdint>
+#include <pthread.h>
+#include <stdexcept>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+#include <vector>
+namespace Origin {
+/* Runs command lines as jobs, any number at once. The foreground job's output
+goes straight to the scrollback. A background job, started with '&' or moved
+there with Ctrl-Z, keeps its output in its own ring and only its latest line is
+shown live; when it finishes the whole buffer is appended to the scrollback
+under its status line, so concurrent jobs never interleave their output.
+Children are reaped when SIGCHLD arrives on a signalfd, which shares one epoll
+instance with every job's output pipes so the caller waits on one descriptor.
+SIGCHLD is blocked by the constructor, which must therefore run before any
+other thread is started. */
+struct Jobs {
+  /* A command line, or an and-or list of one sent to the background. Id is 0
+  for the foreground job. Key tags the job's descriptor and never changes. */
+  struct Job {
+    int Id{0};
+    uint32_t Key{0};
+    bool Stopped{false};
+    std::string Text{};
+    Exec *Proc{nullptr};
+  };
+
+private:
+  static const uint32_t SignalEvent = 0xffffffff;
+  std::vector<Job> Table;
+  int Signals{-1};
+  int Epoll{-1};
+  uint32_t NextKey{0};
+  /* A job 'fg' asked for, brought forward once the foreground is free. */
+  int Promote{0};
+  /* Id of the job 'wait' is waiting for, -1 for all of them, or 0. */
+  int Waiting{0};
+  Terminal *Sink{nullptr};
+  int Cols{80};
+  int Rows{24};
+  Builtins *Cmds{nullptr};
+  std::string Line;
+  /* Jobs finished so far, and the status of the last foreground one. */
+  size_t Finished{0};
+  int Last{0};
+  /* Runs lines of built-ins beside the foreground job, created on first
+  use. It never starts a process, so its output ring is small. */
+  static const size_t InlineRing = 4096;
+  Exec *Inline{nullptr};
+  /* Calls into a job's executor in progress. A built-in such as 'fg' may be
+  running on the executor's stack, so no job is finished until they return. */
+  int Calls{0};
+
+  auto Find(int id) -> Job * {
+    for (auto &job : Table) {
+      if (job.Id == id) {
+        return &job;
+      }
+    }
+    return nullptr;
+  }
+  // Returns one more than the highest background job id.
+  auto NextId() const -> int {
+    int id = 0;
+    for (auto const &job : Table) {
+      id = (job.Id > id) ? job.Id : id;
+    }
+    return id + 1;
+  }
+  // Returns the job with the given id, or the newest background job when id
+  // is 0.
+  auto Pick(int id) -> Job * { return Find((id > 0) ? id : NextId() - 1); }
+  // Removes escape sequences and carriage returns from a line of output.
+  static auto Strip(std::string &text) -> void {
+    size_t out = 0;
+    for (size_t i = 0; i < text.size(); i++) {
+      if (text[i] == '\033') {
+        // Skip a CSI sequence to its final byte, or the byte after ESC.
+        if (i + 1 < text.size() && text[i + 1] == '[') {
+          i += 2;
+          while (i < text.size() && (text[i] < 0x40 || text[i] > 0x7e)) {
+            i++;
+          }
+        } else {
+          i++;
+        }
+      } else if (text[i] != '\r') {
+        text[out++] = text[i];
+      }
+    }
+    text.resize(out);
+  }
+  auto Report(const Job &job, const std::string &state) -> void {
+    if (Sink != nullptr) {
+      Sink->Append("[" + std::to_string(job.Id) + "] " + state + "  " +
+                   job.Text + "\n");
+    }
+  }
+  // Creates a job and registers its output with the epoll instance.
+  auto Add(int id, const std::string &text) -> Exec * {
+    Job job;
+    job.Id = id;
+    job.Key = NextKey++;
+    job.Text = text;
+    job.Proc = new Exec;
+    job.Proc->SetBuiltins(Cmds);
+    job.Proc->SetSink((id == 0) ? Sink : nullptr);
+    job.Proc->SetInteractive(id == 0);
+    job.Proc->SetSize(Cols, Rows);
+    job.Proc->SetDetach([this](Script &script) { Detach(script); });
+    struct epoll_event ev {};
+    ev.events = EPOLLIN;
+    ev.data.u32 = job.Key;
+    epoll_ctl(Epoll, EPOLL_CTL_ADD, job.Proc->GetFd(), &ev);
+    Table.push_back(job);
+    return job.Proc;
+  }
+  // Starts an and-or list ended by '&' as a new background job.
+  auto Detach(Script &script) -> void {
+    std::string text;
+    for (auto const &pipeline : script.Pipelines) {
+      if (!text.empty()) {
+        text += (pipeline.When == Pipeline::IfSuccess) ? " && " : " || ";
+      }
+      text += pipeline.Text;
+    }
+    int const id = NextId();
+    Exec *proc = Add(id, text);
+    proc->Isolate();
+    Calls++;
+    proc->Run(std::move(script));
+    Calls--;
+    if (Sink != nullptr) {
+      Sink->Append("[" + std::to_string(id) + "] " +
+                   std::to_string(proc->GetPid()) + "\n");
+    }
+  }
+  // Returns the executor for lines of built-ins.
+  auto GetInline() -> Exec * {
+    if (Inline == nullptr) {
+      Inline = new Exec(InlineRing);
+      Inline->SetBuiltins(Cmds);
+      Inline->SetSink(Sink);
+    }
+    return Inline;
+  }
+  // Removes the job at an index once it has finished. A background job's
+  // buffered output is appended to the scrollback under its status.
+  auto Finish(size_t index) -> void {
+    Job const job = Table[index];
+    Table.erase(Table.begin() + long(index));
+    Finished++;
+    if (job.Id == 0) {
+      Last = job.Proc->GetStatus();
+    } else {
+      int const status = job.Proc->GetStatus();
+      Report(job, (status == 0) ? "Done"
+                                : "Exit " + std::to_string(status));
+      Ring &text = job.Proc->GetText();
+      if (Sink != nullptr && text.Size() > 0) {
+        if (text.Dropped() > 0) {
+          Sink->Append("[" + std::to_string(text.Dropped()) +
+                       " bytes dropped]\n");
+        }
+        text.Tail(Line, SIZE_MAX);
+        Sink->Append(Line);
+        if (Line.back() != '\n') {
+          Sink->Append("\n");
+        }
+      }
+    }
+    epoll_ctl(Epoll, EPOLL_CTL_DEL, job.Proc->GetFd(), nullptr);
+    delete job.Proc;
+  }
+  // Moves the foreground job to the background once it is stopped or about
+  // to be.
+  auto Demote(Job &job) -> void {
+    job.Id = NextId();
+    job.Proc->GetText().Clear();
+    job.Proc->SetSink(nullptr);
+  }
+  // Makes a background job the foreground job, copying what it printed in
+  // the background into the scrollback first.
+  auto Foreground(Job &job) -> void {
+    if (Sink != nullptr) {
+      Sink->Append(job.Text + "\n");
+      job.Proc->GetText().Tail(Line, SIZE_MAX);
+      Sink->Append(Line);
+    }
+    job.Id = 0;
+    job.Proc->SetSink(Sink);
+    if (job.Stopped) {
+      job.Proc->Kill(SIGCONT);
+    }
+  }
+  // Finishes jobs that are done, reports jobs that stopped, moving a stopped
+  // foreground job to the background, and brings a job forward for 'fg' once
+  // the foreground is free. Does nothing while a job's executor is being
+  // called.
+  auto Collect() -> void {
+    if (Calls > 0) {
+      return;
+    }
+    for (size_t i = Table.size(); i > 0; i--) {
+      Job &job = Table[i - 1];
+      if (!job.Proc->IsRunning()) {
+        Finish(i - 1);
+      } else if (job.Stopped != job.Proc->IsStopped()) {
+        job.Stopped = !job.Stopped;
+        // A program on its controlling terminal stops itself, or is stopped
+        // by the line discipline, without Suspend() being called.
+        if (job.Stopped && job.Id == 0) {
+          Demote(job);
+        }
+        if (job.Stopped) {
+          Report(job, "Stopped");
+        }
+      }
+    }
+    if (Promote > 0 && Find(0) == nullptr) {
+      Job *job = Find(Promote);
+      if (job != nullptr) {
+        Foreground(*job);
+      }
+      Promote = 0;
+    }
+    if ((Waiting == -1 && NextId() == 1) ||
+        (Waiting > 0 && Find(Waiting) == nullptr)) {
+      Waiting = 0;
+    }
+  }
+
+public:
+  Jobs() {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+    Signals = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (Signals == -1) {
+      throw std::runtime_error("signalfd() failed!");
+    }
+    Epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (Epoll == -1) {
+      throw std::runtime_error("epoll_create1() failed!");
+    }
+    struct epoll_event ev {};
+    ev.events = EPOLLIN;
+    ev.data.u32 = SignalEvent;
+    epoll_ctl(Epoll, EPOLL_CTL_ADD, Signals, &ev);
+  }
+  ~Jobs() {
+    for (auto &job : Table) {
+      delete job.Proc;
+    }
+    delete Inline;
+    close(Signals);
+    close(Epoll);
+  }
+  Jobs(const Jobs &) = delete;
+  auto operator=(const Jobs &) -> Jobs & = delete;
+  // Starts a command line as the foreground job. Returns -1 if there is one
+  // already or 'wait' is in progress.
+  auto Run(const std::string &line) -> int {
+    if (IsBusy()) {
+      return -1;
+    }
+    Exec *proc = Add(0, line);
+    Calls++;
+    proc->Run(line);
+    Calls--;
+    Collect();
+    return 0;
+  }
+  // Returns true if a line would run entirely in the shell, being built-ins
+  // and assignments only, or does not parse. Such a line is taken even while
+  // a foreground job runs.
+  auto IsInline(const std::string &line) -> bool {
+    Script script;
+    return !Parser::Parse(line, script) || GetInline()->IsInline(script);
+  }
+  // Runs a line IsInline() accepted, parsed and expanded like any other,
+  // beside the foreground job.
+  auto RunInline(const std::string &line) -> void {
+    GetInline()->Run(line);
+    Collect();
+  }
+  // Moves output from every job with some ready into its buffer and, after a
+  // SIGCHLD, reaps every job. With 'every' set all jobs are polled, as a
+  // fallback for children whose exit was not signalled. Returns the number of
+  // bytes read.
+  auto Poll(bool every = false) -> size_t {
+    struct epoll_event events[16];
+    size_t total = 0;
+    int const n = epoll_wait(Epoll, events, 16, 0);
+    for (int i = 0; i < n; i++) {
+      if (events[i].data.u32 == SignalEvent) {
+        struct signalfd_siginfo info;
+        while (read(Signals, &info, sizeof(info)) > 0) {
+        }
+        every = true;
+        continue;
+      }
+      for (size_t j = 0; j < Table.size(); j++) {
+        if (Table[j].Key == events[i].data.u32) {
+          Calls++;
+          total += Table[j].Proc->Poll(0);
+          Calls--;
+          break;
+        }
+      }
+    }
+    // Reaping may start detached jobs, so the list can grow while walking it.
+    for (size_t j = 0; every && j < Table.size(); j++) {
+      Calls++;
+      total += Table[j].Proc->Poll(0);
+      Calls--;
+    }
+    Collect();
+    return total;
+  }
+  // Interrupts the foreground job and drops the rest of its line, or stops
+  // waiting. A job on its controlling terminal is sent Ctrl-C as a keystroke
+  // for the line discipline to turn into SIGINT, if the program asked for
+  // that. Returns false if there was nothing to interrupt.
+  auto Interrupt() -> bool {
+    Job *job = Find(0);
+    if (job != nullptr && job->Proc->IsSession()) {
+      return job->Proc->Input("\003", 1);
+    }
+    if (job != nullptr) {
+      job->Proc->Cancel();
+      job->Proc->Kill(SIGINT);
+      return true;
+    }
+    bool const waiting = (Waiting != 0);
+    Waiting = 0;
+    return waiting;
+  }
+  // Stops the foreground job and moves it to the background. A job in a
+  // session of its own is an orphaned process group, for which the kernel
+  // discards SIGTSTP whether it comes from the line discipline or from here,
+  // so it is sent SIGSTOP instead. Returns false if there is none.
+  auto Suspend() -> bool {
+    Job *job = Find(0);
+    if (job == nullptr) {
+      return false;
+    }
+    bool const session = job->Proc->IsSession();
+    Demote(*job);
+    job->Proc->Kill(session ? SIGSTOP : SIGTSTP);
+    return true;
+  }
+  // Writes keystrokes to the terminal of the foreground job. Returns false if
+  // there is no foreground job reading one.
+  auto Input(const char *data, size_t size) -> bool {
+    Job *job = Find(0);
+    return job != nullptr && job->Proc->Input(data, size);
+  }
+  // Returns true if the foreground job reads its terminal in non-canonical
+  // mode, so keys should go to it as they are typed.
+  auto IsRaw() -> bool {
+    Job *job = Find(0);
+    return job != nullptr && job->Proc->IsRaw();
+  }
+  // Runs 'fg [id]': the job becomes the foreground job, and is continued if
+  // it was stopped, once the line running 'fg' has finished.
+  auto Fg(int id) -> int {
+    Job *job = Pick(id);
+    if (job == nullptr || job->Id == 0) {
+      return -1;
+    }
+    Promote = job->Id;
+    return 0;
+  }
+  // Runs 'bg [id]': a stopped job is continued in the background.
+  auto Bg(int id) -> int {
+    Job *job = Pick(id);
+    if (job == nullptr || job->Id == 0) {
+      return -1;
+    }
+    Report(*job, "Continued");
+    return job->Proc->Kill(SIGCONT);
+  }
+  // Runs 'wait [id]': no new foreground job starts until the job, or every
+  // background job when id is 0, has finished.
+  auto Wait(int id) -> int {
+    if (id > 0 && Find(id) == nullptr) {
+      return -1;
+    }
+    Waiting = (id > 0) ? id : -1;
+    return 0;
+  }
+  // Lists the background jobs, one line each, for 'jobs'.
+  auto List() -> std::string {
+    std::string out;
+    for (int id = 1; id < NextId(); id++) {
+      const Job *job = Find(id);
+      if (job != nullptr) {
+        out += "[" + std::to_string(id) + "] " +
+               (job->Stopped ? "Stopped  " : "Running  ") + job->Text + "\n";
+      }
+    }
+    return out;
+  }
+  // Describes at most 'rows' background jobs for the live view, each with the
+  // latest line it printed, in lines of at most 'width' columns. Returns the
+  // number of lines.
+  auto Describe(std::string &out, size_t rows, size_t width) -> size_t {
+    out.clear();
+    size_t lines = 0;
+    for (int id = 1; id < NextId() && lines < rows; id++) {
+      const Job *job = Find(id);
+      if (job == nullptr) {
+        continue;
+      }
+      std::string line = "[" + std::to_string(id) + "] " +
+                         (job->Stopped ? "Stopped  " : "Running  ") +
+                         job->Text;
+      // Long commands are cut short so the output still fits.
+      if (line.size() > width / 2 && width > 8) {
+        line.resize(width / 2 - 3);
+        line += "...";
+      }
+      job->Proc->GetText().Tail(Line, 1);
+      Strip(Line);
+      while (!Line.empty() && (Line.back() == '\n' || Line.back() == '\r')) {
+        Line.pop_back();
+      }
+      if (!Line.empty()) {
+        line += " | " + Line;
+      }
+      if (line.size() > width) {
+        line.resize(width);
+      }
+      out += line + "\n";
+      lines++;
+    }
+    return lines;
+  }
+  // Returns the number of background jobs.
+  auto Background() const -> size_t {
+    size_t count = 0;
+    for (auto const &job : Table) {
+      count += (job.Id > 0) ? 1 : 0;
+    }
+    return count;
+  }
+  // Returns how many jobs have finished, which changes whenever one does.
+  auto GetFinished() const -> size_t { return Finished; }
+  // Returns the exit status of the last foreground job.
+  auto GetLast() const -> int { return Last; }
+  // Returns true while a foreground job runs or 'wait' is in progress.
+  auto IsBusy() -> bool { return Find(0) != nullptr || Waiting != 0; }
+  // Returns the epoll descriptor, readable when a job has output or a child
+  // changed state.
+  auto GetFd() const -> int { return Epoll; }
+  // Sets the terminal that receives foreground output and job reports.
+  auto SetSink(Terminal *sink) -> void {
+    Sink = sink;
+    if (Inline != nullptr) {
+      Inline->SetSink(sink);
+    }
+  }
+  // Sets the size of the terminal jobs see.
+  auto SetSize(int cols, int rows) -> void {
+    if (cols == Cols && rows == Rows) {
+      return;
+    }
+    Cols = cols;
+    Rows = rows;
+    for (auto &job : Table) {
+      job.Proc->SetSize(cols, rows);
+    }
+  }
+  // Sets the built-ins jobs run in the shell.
+  auto SetBuiltins(Builtins *cmds) -> void {
+    Cmds = cmds;
+    if (Inline != nullptr) {
+      Inline->SetBuiltins(cmds);
+    }
+  }
+};
+} // namespace Origin
+#endif // JOBS_HPP
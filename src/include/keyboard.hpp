@@ -0,0 +1,246 @@
+#ifndef KEYBOARD_HPP
+#define KEYBOARD_HPP
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+namespace Origin {
+/* Decodes terminal input into key codes. Everything the terminal has sent is
+taken with a single read() and decoded in one pass; plain bytes map to their
+character code and the common escape sequences map to the Key* constants below.
+An escape sequence split across two reads is kept until the rest arrives.
+With bracketed paste enabled the terminal wraps pasted text in ESC[200~ and
+ESC[201~; everything between is collected as it is, newlines included, and
+reported as a single KeyPaste, with the rest of the paste read at once while it
+keeps arriving rather than one main loop wakeup per chunk. */
+struct Keyboard {
+private:
+  static constexpr const char *PasteEnd = "\033[201~";
+  static constexpr size_t PasteEndLen = 6;
+  /* Reported by DecodeEscape() for ESC[200~ and never returned. */
+  static constexpr int PasteBegin = 0x11FFFF;
+  char Buffer[65536];
+  size_t Pending{0};
+  std::vector<int> Keys;
+  /* Text of the pastes completed by the last Read(), followed by the one
+  still open, with the span of each completed one and how many of them have
+  been taken. */
+  bool Pasting{false};
+  std::string Paste;
+  size_t PasteStart{0};
+  std::vector<std::pair<size_t, size_t>> Spans;
+  size_t Taken{0};
+
+  // Decodes the CSI or SS3 sequence starting at s[0] == ESC. Returns the
+  // number of bytes consumed, or 0 if the sequence is incomplete.
+  auto DecodeEscape(const char *s, size_t len, int &key) -> size_t {
+    if (len < 2) {
+      return 0;
+    }
+    if (s[1] == 'b' || s[1] == 'f') {
+      // Alt-b and Alt-f move by words.
+      key = (s[1] == 'b') ? KeyWordLeft : KeyWordRight;
+      return 2;
+    }
+    if (s[1] != '[' && s[1] != 'O') {
+      key = KeyEscape;
+      return 1;
+    }
+    size_t i = 2;
+    int param = 0;
+    int modifier = 0;
+    while (i < len && s[i] >= '0' && s[i] <= '9') {
+      param = param * 10 + (s[i] - '0');
+      i++;
+    }
+    while (i < len && s[i] == ';') {
+      i++;
+      modifier = 0;
+      while (i < len && s[i] >= '0' && s[i] <= '9') {
+        modifier = modifier * 10 + (s[i] - '0');
+        i++;
+      }
+    }
+    if (i >= len) {
+      return 0;
+    }
+    switch (s[i]) {
+    case 'A':
+      key = KeyUp;
+      break;
+    case 'B':
+      key = KeyDown;
+      break;
+    case 'C':
+      // Alt (3) or Ctrl (5) with an arrow moves by words.
+      key = (modifier == 3 || modifier == 5) ? KeyWordRight : KeyRight;
+      break;
+    case 'D':
+      key = (modifier == 3 || modifier == 5) ? KeyWordLeft : KeyLeft;
+      break;
+    case 'H':
+      key = KeyHome;
+      break;
+    case 'F':
+      key = KeyEnd;
+      break;
+    case '~':
+      key = TildeKey(param);
+      break;
+    default:
+      key = KeyUnknown;
+      break;
+    }
+    return i + 1;
+  }
+  static auto TildeKey(int param) -> int {
+    switch (param) {
+    case 200:
+      return PasteBegin;
+    case 1:
+    case 7:
+      return KeyHome;
+    case 2:
+      return KeyInsert;
+    case 3:
+      return KeyDelete;
+    case 4:
+    case 8:
+      return KeyEnd;
+    case 5:
+      return KeyPageUp;
+    case 6:
+      return KeyPageDown;
+    default:
+      return KeyUnknown;
+    }
+  }
+
+  // Takes pasted text from s up to the end marker, ending the paste if it is
+  // there. Returns the number of bytes consumed; a possible start of the
+  // marker at the end is left for the next read.
+  auto TakePaste(const char *s, size_t len) -> size_t {
+    const void *end = memmem(s, len, PasteEnd, PasteEndLen);
+    if (end != nullptr) {
+      size_t const at = static_cast<size_t>(static_cast<const char *>(end) - s);
+      Paste.append(s, at);
+      Spans.emplace_back(PasteStart, Paste.size());
+      Pasting = false;
+      Keys.push_back(KeyPaste);
+      return at + PasteEndLen;
+    }
+    size_t keep = 0;
+    for (size_t k = 1; k < PasteEndLen && k <= len; k++) {
+      if (memcmp(s + len - k, PasteEnd, k) == 0) {
+        keep = k;
+      }
+    }
+    Paste.append(s, len - keep);
+    return len - keep;
+  }
+  static auto HasInput(int fd) -> bool {
+    struct pollfd p {};
+    p.fd = fd;
+    p.events = POLLIN;
+    return poll(&p, 1, 0) > 0 && (p.revents & POLLIN) != 0;
+  }
+
+public:
+  /* Codes for keys that do not produce a character. They start above the
+  Unicode range so they never collide with typed text. */
+  static constexpr int KeyUnknown = 0x110000, KeyUp = 0x110001,
+                   KeyDown = 0x110002, KeyLeft = 0x110003,
+                   KeyRight = 0x110004, KeyHome = 0x110005,
+                   KeyEnd = 0x110006, KeyPageUp = 0x110007,
+                   KeyPageDown = 0x110008, KeyInsert = 0x110009,
+                   KeyDelete = 0x11000A, KeyWordLeft = 0x11000B,
+                   KeyWordRight = 0x11000C, KeyPaste = 0x11000D,
+                   KeyEscape = 27;
+  // Reads whatever is waiting on fd with one read() and decodes it. Returns
+  // the decoded keys, which stay valid until the next call, and sets 'closed'
+  // if the descriptor reached its end or failed. The result may be empty
+  // while a sequence or paste is unfinished. While a paste is open, further
+  // reads follow as long as more is waiting.
+  auto Read(int fd, bool &closed) -> const std::vector<int> & {
+    Keys.clear();
+    Spans.clear();
+    Taken = 0;
+    Paste.erase(0, Pasting ? PasteStart : Paste.size());
+    PasteStart = 0;
+    ssize_t n = read(fd, Buffer + Pending, sizeof(Buffer) - Pending);
+    closed = n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR);
+    if (n <= 0) {
+      return Keys;
+    }
+    while (n > 0) {
+      size_t const len = Pending + static_cast<size_t>(n);
+      size_t i = 0;
+      while (i < len) {
+        if (Pasting) {
+          size_t const used = TakePaste(Buffer + i, len - i);
+          i += used;
+          if (Pasting) {
+            break;
+          }
+        } else if (Buffer[i] == '\033') {
+          int key = KeyEscape;
+          size_t const used = DecodeEscape(Buffer + i, len - i, key);
+          if (used == 0) {
+            // A lone ESC at the end of a read is the Escape key itself; a
+            // longer prefix is an unfinished sequence.
+            if (len - i == 1) {
+              Keys.push_back(KeyEscape);
+              i++;
+            }
+            break;
+          }
+          if (key == PasteBegin) {
+            Pasting = true;
+            PasteStart = Paste.size();
+          } else {
+            Keys.push_back(key);
+          }
+          i += used;
+        } else {
+          Keys.push_back(static_cast<unsigned char>(Buffer[i]));
+          i++;
+        }
+      }
+      Pending = len - i;
+      std::memmove(Buffer, Buffer + i, Pending);
+      if (Pending == sizeof(Buffer)) {
+        Pending = 0;
+      }
+      n = (Pasting && HasInput(fd))
+              ? read(fd, Buffer + Pending, sizeof(Buffer) - Pending)
+              : 0;
+    }
+    return Keys;
+  }
+  // Reads whatever is waiting on fd with one read() and returns it as it is,
+  // after the bytes of an unfinished sequence kept from the last Read(), for
+  // a program that takes keys straight from its terminal. The result stays
+  // valid until the next call. Sets 'closed' like Read().
+  auto ReadRaw(int fd, bool &closed) -> std::string_view {
+    ssize_t const n = read(fd, Buffer + Pending, sizeof(Buffer) - Pending);
+    closed = n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR);
+    size_t const len = Pending + static_cast<size_t>((n > 0) ? n : 0);
+    Pending = 0;
+    return std::string_view(Buffer, len);
+  }
+  // Returns the text of the next KeyPaste returned by the last Read(), valid
+  // until the next Read().
+  auto NextPaste() -> std::string_view {
+    if (Taken >= Spans.size()) {
+      return std::string_view();
+    }
+    auto const span = Spans[Taken++];
+    return std::string_view(Paste).substr(span.first, span.second - span.first);
+  }
+};
+} // namespace Origin
+#endif // KEYBOARD_HPP
@@ -0,0 +1,372 @@
+#ifndef LINEEDIT_HPP
+#define LINEEDIT_HPP
+#include "keyboard.hpp"
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+// The textedit engine checks its undo buffer with the GUI's assert macro.
+#ifndef ASSERT
+#define ASSERT(_EXPR) assert(_EXPR)
+#endif
+namespace Origin {
+/* The characters of the input line as Unicode code points, stored with a gap
+at the cursor. Typing and deleting at the cursor only move the gap's edges, and
+moving the cursor moves the characters between the old and new positions, so
+an edit costs nothing like the length of the line. The buffer grows by
+doubling and never shrinks, so a line that was once long edits without
+allocating. */
+struct GapBuffer {
+  using Char = unsigned int;
+
+private:
+  std::vector<Char> Chars;
+  size_t Gap{0};
+  size_t GapEnd{0};
+
+  auto MoveGap(size_t pos) -> void {
+    if (pos < Gap) {
+      size_t const n = Gap - pos;
+      memmove(&Chars[GapEnd - n], &Chars[pos], n * sizeof(Char));
+      Gap -= n;
+      GapEnd -= n;
+    } else if (pos > Gap) {
+      size_t const n = pos - Gap;
+      memmove(&Chars[Gap], &Chars[GapEnd], n * sizeof(Char));
+      Gap += n;
+      GapEnd += n;
+    }
+  }
+  // Widens the gap to at least 'n' characters.
+  auto Reserve(size_t n) -> void {
+    if (GapEnd - Gap >= n) {
+      return;
+    }
+    size_t const tail = Chars.size() - GapEnd;
+    size_t size = (Chars.size() > 0) ? Chars.size() * 2 : 256;
+    while (size < Size() + n) {
+      size *= 2;
+    }
+    Chars.resize(size);
+    if (tail > 0) {
+      memmove(&Chars[size - tail], &Chars[GapEnd], tail * sizeof(Char));
+    }
+    GapEnd = size - tail;
+  }
+
+public:
+  auto Size() const -> size_t { return Chars.size() - (GapEnd - Gap); }
+  auto At(size_t i) const -> Char {
+    return (i < Gap) ? Chars[i] : Chars[i + (GapEnd - Gap)];
+  }
+  auto Insert(size_t pos, const Char *text, size_t n) -> void {
+    Reserve(n);
+    MoveGap(pos);
+    memcpy(&Chars[Gap], text, n * sizeof(Char));
+    Gap += n;
+  }
+  auto Erase(size_t pos, size_t n) -> void {
+    MoveGap(pos);
+    GapEnd += n;
+  }
+  auto Clear() -> void {
+    Gap = 0;
+    GapEnd = Chars.size();
+  }
+};
+/* A private instance of the STB textedit engine. The GUI compiles its own at
+global scope, so the header's include guard is set aside while it is included
+again here; the state types declared in this namespace then keep overload
+resolution from ever seeing the GUI's functions. */
+namespace TextEdit {
+#pragma push_macro("INCLUDE_STB_TEXTEDIT_H")
+#undef INCLUDE_STB_TEXTEDIT_H
+#undef STB_TEXTEDIT_IMPLEMENTATION
+#undef STB_TEXTEDIT_CHARTYPE
+#define STB_TEXTEDIT_CHARTYPE GapBuffer::Char
+#include "textedit.hpp"
+// The callbacks the textedit engine is built on, for a single line in a
+// monospaced terminal where every character is one column wide.
+static int STB_TEXTEDIT_STRINGLEN(const GapBuffer *str) {
+  return static_cast<int>(str->Size());
+}
+static void STB_TEXTEDIT_LAYOUTROW(StbTexteditRow *row, GapBuffer *str,
+                                   int start) {
+  row->x0 = 0.0f;
+  row->x1 = static_cast<float>(str->Size()) - static_cast<float>(start);
+  row->baseline_y_delta = 1.0f;
+  row->ymin = 0.0f;
+  row->ymax = 1.0f;
+  row->num_chars = static_cast<int>(str->Size()) - start;
+}
+static float STB_TEXTEDIT_GETWIDTH(GapBuffer *, int, int) { return 1.0f; }
+static int STB_TEXTEDIT_KEYTOTEXT(int key) {
+  return (key >= 0x20 && key < 0x110000) ? key : 0;
+}
+static GapBuffer::Char STB_TEXTEDIT_GETCHAR(const GapBuffer *str, int i) {
+  return str->At(static_cast<size_t>(i));
+}
+static const GapBuffer::Char STB_TEXTEDIT_NEWLINE = '\n';
+static void STB_TEXTEDIT_DELETECHARS(GapBuffer *str, int pos, int n) {
+  str->Erase(static_cast<size_t>(pos), static_cast<size_t>(n));
+}
+static bool STB_TEXTEDIT_INSERTCHARS(GapBuffer *str, int pos,
+                                     const GapBuffer::Char *text, int n) {
+  str->Insert(static_cast<size_t>(pos), text, static_cast<size_t>(n));
+  return true;
+}
+#undef STB_TEXTEDIT_STRING
+#undef STB_TEXTEDIT_MOVEWORDLEFT
+#undef STB_TEXTEDIT_MOVEWORDRIGHT
+#define STB_TEXTEDIT_STRING GapBuffer
+#define STB_TEXTEDIT_IS_SPACE(ch) ((ch) == ' ' || (ch) == '\t')
+// The key codes match the GUI's definitions so either header may come first.
+#define STB_TEXTEDIT_K_LEFT 0x200000
+#define STB_TEXTEDIT_K_RIGHT 0x200001
+#define STB_TEXTEDIT_K_UP 0x200002
+#define STB_TEXTEDIT_K_DOWN 0x200003
+#define STB_TEXTEDIT_K_LINESTART 0x200004
+#define STB_TEXTEDIT_K_LINEEND 0x200005
+#define STB_TEXTEDIT_K_TEXTSTART 0x200006
+#define STB_TEXTEDIT_K_TEXTEND 0x200007
+#define STB_TEXTEDIT_K_DELETE 0x200008
+#define STB_TEXTEDIT_K_BACKSPACE 0x200009
+#define STB_TEXTEDIT_K_UNDO 0x20000A
+#define STB_TEXTEDIT_K_REDO 0x20000B
+#define STB_TEXTEDIT_K_WORDLEFT 0x20000C
+#define STB_TEXTEDIT_K_WORDRIGHT 0x20000D
+#define STB_TEXTEDIT_K_PGUP 0x20000E
+#define STB_TEXTEDIT_K_PGDOWN 0x20000F
+#define STB_TEXTEDIT_K_SHIFT 0x400000
+#define STB_TEXTEDIT_K_INSERT 0x200010
+#ifndef STB_TEXTEDIT_memmove
+#define STB_TEXTEDIT_memmove memmove
+#endif
+#define STB_TEXTEDIT_IMPLEMENTATION
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#include "textedit.hpp"
+#pragma GCC diagnostic pop
+#undef STB_TEXTEDIT_IMPLEMENTATION
+#undef STB_TEXTEDIT_STRING
+#undef STB_TEXTEDIT_CHARTYPE
+#undef STB_TEXTEDIT_IS_SPACE
+#undef STB_TEXTEDIT_MOVEWORDLEFT
+#undef STB_TEXTEDIT_MOVEWORDRIGHT
+#undef STB_TEXTEDIT_K_INSERT
+#undef INCLUDE_STB_TEXTEDIT_H
+#pragma pop_macro("INCLUDE_STB_TEXTEDIT_H")
+} // namespace TextEdit
+/* The input line editor: the STB textedit engine over a gap buffer of code
+points. It gives cursor and word motion, deletion by character, word or line,
+overwrite mode and undo/redo. Keys arrive as raw bytes, so UTF-8 sequences are
+assembled into code points before they are inserted. The line is encoded back
+to UTF-8 only when it is read after a change, into a string whose capacity is
+kept, so editing does not allocate once the buffers are as large as the longest
+line. */
+struct LineEdit {
+private:
+  /* The engine's overwrite toggle, whose code is only defined while it is
+  compiled. */
+  static constexpr int InsertKey = 0x200010;
+  GapBuffer Chars;
+  TextEdit::STB_TexteditState State{};
+  std::string Utf8;
+  bool Stale{false};
+  /* The code point being assembled from a UTF-8 sequence, and how many
+  continuation bytes it still needs. */
+  GapBuffer::Char Partial{0};
+  int Needed{0};
+  std::vector<GapBuffer::Char> Decoded;
+
+  auto Press(int key) -> void {
+    TextEdit::textedit_key(&Chars, &State, key);
+    Stale = true;
+  }
+  static auto Encode(GapBuffer::Char c, std::string &out) -> void {
+    if (c < 0x80) {
+      out += static_cast<char>(c);
+    } else if (c < 0x800) {
+      out += static_cast<char>(0xC0 | (c >> 6));
+      out += static_cast<char>(0x80 | (c & 0x3F));
+    } else if (c < 0x10000) {
+      out += static_cast<char>(0xE0 | (c >> 12));
+      out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+      out += static_cast<char>(0x80 | (c & 0x3F));
+    } else {
+      out += static_cast<char>(0xF0 | (c >> 18));
+      out += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+      out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+      out += static_cast<char>(0x80 | (c & 0x3F));
+    }
+  }
+  static auto Length(GapBuffer::Char c) -> size_t {
+    return (c < 0x80) ? 1 : (c < 0x800) ? 2 : (c < 0x10000) ? 3 : 4;
+  }
+  // Feeds one byte of UTF-8. Returns the completed code point, or 0 while a
+  // sequence is unfinished or after a malformed byte, which is dropped.
+  auto Assemble(int byte) -> GapBuffer::Char {
+    if (byte < 0x80) {
+      Needed = 0;
+      return static_cast<GapBuffer::Char>(byte);
+    }
+    if (byte >= 0xC2 && byte <= 0xF4) {
+      Needed = (byte >= 0xF0) ? 3 : (byte >= 0xE0) ? 2 : 1;
+      Partial = static_cast<GapBuffer::Char>(byte) & (0x3Fu >> Needed);
+      return 0;
+    }
+    if (byte >= 0xC0 || Needed == 0) {
+      Needed = 0;
+      return 0;
+    }
+    Partial = (Partial << 6) | (static_cast<GapBuffer::Char>(byte) & 0x3F);
+    return (--Needed == 0) ? Partial : 0;
+  }
+  // Decodes UTF-8 text into Decoded, dropping malformed bytes and control
+  // characters other than tab and newline. Carriage returns, which terminals
+  // paste for line ends, become newlines.
+  auto Decode(std::string_view text) -> void {
+    Decoded.clear();
+    Needed = 0;
+    for (size_t i = 0; i < text.size(); i++) {
+      GapBuffer::Char c = Assemble(static_cast<unsigned char>(text[i]));
+      if (c == '\r') {
+        if (i + 1 < text.size() && text[i + 1] == '\n') {
+          continue;
+        }
+        c = '\n';
+      }
+      if ((c >= 0x20 && c != 0x7f) || c == '\t' || c == '\n') {
+        Decoded.push_back(c);
+      }
+    }
+  }
+
+public:
+  LineEdit() { TextEdit::textedit_initialize_state(&State, 1); }
+  // Applies a key from Keyboard. Returns false if the key does not edit the
+  // line, leaving it to the caller.
+  auto Key(int key) -> bool {
+    if (key >= 0x80 && key < 0x100) {
+      key = static_cast<int>(Assemble(key));
+      if (key != 0) {
+        Press(key);
+      }
+      return true;
+    }
+    Needed = 0;
+    switch (key) {
+    case Keyboard::KeyLeft:
+    case 2:
+      Press(STB_TEXTEDIT_K_LEFT);
+      break;
+    case Keyboard::KeyRight:
+    case 6:
+      Press(STB_TEXTEDIT_K_RIGHT);
+      break;
+    case Keyboard::KeyWordLeft:
+      Press(STB_TEXTEDIT_K_WORDLEFT);
+      break;
+    case Keyboard::KeyWordRight:
+      Press(STB_TEXTEDIT_K_WORDRIGHT);
+      break;
+    case Keyboard::KeyHome:
+    case 1:
+      Press(STB_TEXTEDIT_K_LINESTART);
+      break;
+    case Keyboard::KeyEnd:
+    case 5:
+      Press(STB_TEXTEDIT_K_LINEEND);
+      break;
+    case Keyboard::KeyDelete:
+    case 4:
+      Press(STB_TEXTEDIT_K_DELETE);
+      break;
+    case Keyboard::KeyInsert:
+      Press(InsertKey);
+      break;
+    case 8:
+    case 127:
+    case Keyboard::KeyEscape:
+      Press(STB_TEXTEDIT_K_BACKSPACE);
+      break;
+    case 23:
+      // Ctrl-W deletes the word before the cursor.
+      Press(STB_TEXTEDIT_K_WORDLEFT | STB_TEXTEDIT_K_SHIFT);
+      Press(STB_TEXTEDIT_K_BACKSPACE);
+      break;
+    case 21:
+      // Ctrl-U deletes up to the start of the line.
+      Press(STB_TEXTEDIT_K_LINESTART | STB_TEXTEDIT_K_SHIFT);
+      Press(STB_TEXTEDIT_K_BACKSPACE);
+      break;
+    case 11:
+      // Ctrl-K deletes to the end of the line.
+      Press(STB_TEXTEDIT_K_LINEEND | STB_TEXTEDIT_K_SHIFT);
+      Press(STB_TEXTEDIT_K_DELETE);
+      break;
+    case 31:
+      // Ctrl-_ undoes and Ctrl-Y redoes.
+      Press(STB_TEXTEDIT_K_UNDO);
+      break;
+    case 25:
+      Press(STB_TEXTEDIT_K_REDO);
+      break;
+    default:
+      if (key < 0x20 || key == 0x7f || key >= Keyboard::KeyUnknown) {
+        return false;
+      }
+      Press(key);
+      break;
+    }
+    return true;
+  }
+  // Inserts UTF-8 text at the cursor, replacing any selection, as one undo
+  // step. A paste of any size is a single insertion.
+  auto Insert(std::string_view text) -> void {
+    Decode(text);
+    TextEdit::textedit_paste(&Chars, &State, Decoded.data(),
+                             static_cast<int>(Decoded.size()));
+    Stale = true;
+  }
+  // Replaces the whole line, leaving the cursor at its end. The old line can
+  // be brought back with undo.
+  auto Set(std::string_view text) -> void {
+    State.select_start = 0;
+    State.select_end = static_cast<int>(Chars.Size());
+    Insert(text);
+  }
+  // Empties the line and forgets its undo history.
+  auto Clear() -> void {
+    Chars.Clear();
+    TextEdit::textedit_clear_state(&State, 1);
+    Needed = 0;
+    Stale = true;
+  }
+  auto Empty() const -> bool { return Chars.Size() == 0; }
+  // Returns the line as UTF-8.
+  auto Text() -> const std::string & {
+    if (Stale) {
+      Utf8.clear();
+      for (size_t i = 0; i < Chars.Size(); i++) {
+        Encode(Chars.At(i), Utf8);
+      }
+      Stale = false;
+    }
+    return Utf8;
+  }
+  // Returns the cursor position as a byte offset into Text().
+  auto GetCursor() const -> size_t {
+    size_t bytes = 0;
+    size_t const cursor = static_cast<size_t>(State.cursor);
+    for (size_t i = 0; i < cursor && i < Chars.Size(); i++) {
+      bytes += Length(Chars.At(i));
+    }
+    return bytes;
+  }
+};
+} // namespace Origin
+#endif // LINEEDIT_HPP
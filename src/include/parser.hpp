@@ -0,0 +1,481 @@
+#ifndef PARSER_HPP
+#define PARSER_HPP
+#include "env.hpp"
+#include <cstdlib>
+#include <fcntl.h>
+#include <glob.h>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
+namespace Origin {
+/* A redirection of one descriptor of a command, such as '2>>log', '<in' or
+'2>&1'. Target is kept in source form and expanded when the command runs. */
+struct Redirect {
+  int Fd{1};
+  int Flags{O_WRONLY | O_CREAT | O_TRUNC};
+  int DupFd{-1};
+  std::string Target{};
+};
+/* One simple command. Words and the values of leading NAME=value assignments
+are kept in source form, quotes included, and expanded when the command
+runs, so '$?' sees the status of the command before it. */
+struct Command {
+  std::vector<std::string> Words{};
+  std::vector<std::string> Assigns{};
+  std::vector<Redirect> Redirects{};
+};
+/* Commands joined by '|', the condition under which the pipeline runs given
+the status of the one before it, and its source text for job listings. */
+struct Pipeline {
+  static const int Always = 0, IfSuccess = 1, IfFailure = 2;
+  std::vector<Command> Commands{};
+  std::string Text{};
+  int When{Always};
+  bool Background{false};
+};
+/* A parsed command line. Fallback is set when the line uses syntax the native
+parser does not handle, such as command substitution, here-documents,
+subshells or compound commands; such lines are handed to /bin/sh whole.
+Incomplete is set with Error when the line ends after an operator, so the
+command goes on in the next line. */
+struct Script {
+  std::vector<Pipeline> Pipelines{};
+  bool Fallback{false};
+  bool Incomplete{false};
+  std::string Error{};
+};
+/* Parses command lines into pipelines joined by ';', newlines, '&', '&&' and
+'||', and expands words at run time. Supports single and double quotes,
+backslash escapes, $NAME, ${NAME}, $?, $$, the positional parameters $0 to
+$9, $#, $@ and $*, a leading ~, globbing and the usual redirections. */
+struct Parser {
+private:
+  static auto IsOperator(char c) -> bool {
+    return c == '|' || c == '&' || c == ';' || c == '<' || c == '>';
+  }
+  static auto IsBlank(char c) -> bool {
+    return c == ' ' || c == '\t' || c == '\n';
+  }
+  static auto IsNameChar(char c, bool first) -> bool {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' ||
+           (!first && c >= '0' && c <= '9');
+  }
+  // Returns line[begin, end) without trailing blanks.
+  static auto Trim(const std::string &line, size_t begin, size_t end)
+      -> std::string {
+    while (end > begin && IsBlank(line[end - 1])) {
+      end--;
+    }
+    return line.substr(begin, end - begin);
+  }
+  // Returns true for a NAME=value word.
+  static auto IsAssign(const std::string &word) -> bool {
+    size_t const eq = word.find('=');
+    if (eq == 0 || eq == std::string::npos) {
+      return false;
+    }
+    for (size_t i = 0; i < eq; i++) {
+      if (!IsNameChar(word[i], i == 0)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  static auto IsReserved(const std::string &word) -> bool {
+    static const char *reserved[] = {"if",   "then",  "else",  "elif",
+                                     "fi",   "for",   "while", "until",
+                                     "do",   "done",  "case",  "esac",
+                                     "!",    "[[",    "function", "select",
+                                     "{",    "}"};
+    for (const char *r : reserved) {
+      if (word == r) {
+        return true;
+      }
+    }
+    return false;
+  }
+  // Scans one word in source form starting at i. Returns false for syntax
+  // that needs the fallback shell.
+  static auto ScanWord(const std::string &line, size_t &i, std::string &word)
+      -> bool {
+    char quote = 0;
+    while (i < line.size()) {
+      char const c = line[i];
+      if (quote == 0 && (IsBlank(c) || IsOperator(c))) {
+        break;
+      }
+      if (quote != '\'' && (c == '`' || (c == '$' && i + 1 < line.size() &&
+                                         line[i + 1] == '('))) {
+        return false;
+      }
+      if (quote == 0 && (c == '(' || c == ')')) {
+        return false;
+      }
+      // '${NAME}' is expanded here; any other '${...}' form is not.
+      if (quote != '\'' && c == '$' && i + 1 < line.size() &&
+          line[i + 1] == '{') {
+        size_t end = i + 2;
+        while (end < line.size() && IsNameChar(line[end], end == i + 2)) {
+          end++;
+        }
+        if (end == i + 2 || end == line.size() || line[end] != '}') {
+          return false;
+        }
+        word += line.substr(i, end + 1 - i);
+        i = end + 1;
+        continue;
+      }
+      if (c == '\\' && quote != '\'' && i + 1 < line.size()) {
+        word += line.substr(i, 2);
+        i += 2;
+        continue;
+      }
+      if ((c == '\'' || c == '"') && (quote == 0 || quote == c)) {
+        quote = (quote == 0) ? c : 0;
+      }
+      word += c;
+      i++;
+    }
+    return quote == 0;
+  }
+  // Appends the value of a variable reference starting at raw[i] == '$',
+  // advancing i past it.
+  static auto ExpandVar(const std::string &raw, size_t &i, int status,
+                        const Environment &env, std::string &out) -> void {
+    i++;
+    if (i < raw.size() && raw[i] == '?') {
+      out += std::to_string(status);
+      i++;
+      return;
+    }
+    if (i < raw.size() && raw[i] == '$') {
+      out += std::to_string(getpid());
+      i++;
+      return;
+    }
+    auto const &params = env.Params();
+    if (i < raw.size() && raw[i] >= '0' && raw[i] <= '9') {
+      size_t const n = static_cast<size_t>(raw[i] - '0');
+      out += (n < params.size()) ? params[n] : std::string();
+      i++;
+      return;
+    }
+    if (i < raw.size() && raw[i] == '#') {
+      out += std::to_string(params.empty() ? 0 : params.size() - 1);
+      i++;
+      return;
+    }
+    if (i < raw.size() && (raw[i] == '@' || raw[i] == '*')) {
+      for (size_t n = 1; n < params.size(); n++) {
+        out += (n > 1) ? " " : "";
+        out += params[n];
+      }
+      i++;
+      return;
+    }
+    bool const braced = (i < raw.size() && raw[i] == '{');
+    size_t const start = braced ? i + 1 : i;
+    size_t end = start;
+    while (end < raw.size() && IsNameChar(raw[end], end == start)) {
+      end++;
+    }
+    if (end == start) {
+      out += '$';
+      return;
+    }
+    const char *value =
+        env.Get(std::string_view(raw).substr(start, end - start));
+    if (value != nullptr) {
+      out += value;
+    }
+    i = (braced && end < raw.size() && raw[end] == '}') ? end + 1 : end;
+  }
+
+public:
+  // Parses a command line. Returns false and sets Error on a syntax error.
+  static auto Parse(const std::string &line, Script &script) -> bool {
+    script = Script{};
+    Pipeline pipeline;
+    Command command;
+    bool expect = false;
+    size_t i = 0;
+    size_t begin = std::string::npos;
+    auto fail = [&script](const std::string &error) {
+      script.Error = error;
+      return false;
+    };
+    auto endCommand = [&]() -> bool {
+      if (command.Words.empty() && command.Assigns.empty() &&
+          command.Redirects.empty()) {
+        return false;
+      }
+      pipeline.Commands.push_back(std::move(command));
+      command = Command{};
+      return true;
+    };
+    while (i < line.size()) {
+      char c = line[i];
+      if (c == '\n') {
+        // A newline ends a pipeline like ';', except on a blank line or
+        // where an operator still expects a command.
+        bool const empty = command.Words.empty() && command.Assigns.empty() &&
+                           command.Redirects.empty() &&
+                           pipeline.Commands.empty();
+        c = (expect || empty) ? ' ' : ';';
+      }
+      if (IsBlank(c)) {
+        i++;
+        continue;
+      }
+      if (c == '#') {
+        // A comment runs to the end of its line.
+        i = line.find('\n', i);
+        i = (i == std::string::npos) ? line.size() : i;
+        continue;
+      }
+      if (begin == std::string::npos) {
+        begin = i;
+      }
+      if (c == '|' || c == '&' || c == ';') {
+        bool const twice =
+            (line[i] != '\n' && i + 1 < line.size() && line[i + 1] == c);
+        // Only '&&' and '||' are operators; ';;' belongs to 'case'.
+        if (c == ';' && twice) {
+          return fail("unexpected ';;'");
+        }
+        if (c == '&' && i + 1 < line.size() && line[i + 1] == '>') {
+          Redirect r;
+          r.Fd = -2;
+          i += 2;
+          if (i < line.size() && line[i] == '>') {
+            r.Flags = O_WRONLY | O_CREAT | O_APPEND;
+            i++;
+          }
+          while (i < line.size() && IsBlank(line[i])) {
+            i++;
+          }
+          if (!ScanWord(line, i, r.Target)) {
+            script.Fallback = true;
+            return true;
+          }
+          if (r.Target.empty()) {
+            return fail("missing file after '&>'");
+          }
+          command.Redirects.push_back(std::move(r));
+          continue;
+        }
+        if (!endCommand()) {
+          return fail(std::string("unexpected '") + c +
+                      (twice ? std::string(1, c) : "") + "'");
+        }
+        if (c == '|' && !twice) {
+          expect = true;
+          i++;
+          continue;
+        }
+        pipeline.Background = (c == '&' && !twice);
+        pipeline.Text = Trim(line, begin, i);
+        begin = std::string::npos;
+        script.Pipelines.push_back(std::move(pipeline));
+        pipeline = Pipeline{};
+        pipeline.When = (!twice) ? Pipeline::Always
+                        : (c == '&') ? Pipeline::IfSuccess
+                                     : Pipeline::IfFailure;
+        expect = twice;
+        i += twice ? 2 : 1;
+        continue;
+      }
+      // A redirection, optionally preceded by a descriptor number.
+      size_t digits = i;
+      while (digits < line.size() && line[digits] >= '0' &&
+             line[digits] <= '9') {
+        digits++;
+      }
+      if (digits < line.size() &&
+          (line[digits] == '<' || line[digits] == '>')) {
+        Redirect r;
+        char const dir = line[digits];
+        r.Fd = (digits > i) ? atoi(line.substr(i, digits - i).c_str())
+                            : (dir == '<' ? 0 : 1);
+        r.Flags = (dir == '<') ? O_RDONLY : O_WRONLY | O_CREAT | O_TRUNC;
+        i = digits + 1;
+        if (i < line.size() && line[i] == '<' && dir == '<') {
+          script.Fallback = true;
+          return true;
+        }
+        if (i < line.size() && line[i] == '>' && dir == '>') {
+          r.Flags = O_WRONLY | O_CREAT | O_APPEND;
+          i++;
+        } else if (i < line.size() && line[i] == '&') {
+          i++;
+          size_t const start = i;
+          while (i < line.size() && line[i] >= '0' && line[i] <= '9') {
+            i++;
+          }
+          if (i == start) {
+            return fail("bad descriptor after '>&'");
+          }
+          r.DupFd = atoi(line.substr(start, i - start).c_str());
+          command.Redirects.push_back(std::move(r));
+          continue;
+        }
+        while (i < line.size() && IsBlank(line[i])) {
+          i++;
+        }
+        if (!ScanWord(line, i, r.Target)) {
+          script.Fallback = true;
+          return true;
+        }
+        if (r.Target.empty()) {
+          return fail(std::string("missing file after '") + dir + "'");
+        }
+        command.Redirects.push_back(std::move(r));
+        continue;
+      }
+      std::string word;
+      if (!ScanWord(line, i, word)) {
+        script.Fallback = true;
+        return true;
+      }
+      if (word.empty()) {
+        // An operator character inside a word, such as a lone '>' after
+        // digits, is left to the next iteration.
+        i++;
+        continue;
+      }
+      if (command.Words.empty() && IsAssign(word)) {
+        command.Assigns.push_back(std::move(word));
+      } else if (command.Words.empty() && IsReserved(word)) {
+        script.Fallback = true;
+        return true;
+      } else {
+        command.Words.push_back(std::move(word));
+      }
+      expect = false;
+    }
+    if (endCommand()) {
+      pipeline.Text = Trim(line, begin, i);
+      script.Pipelines.push_back(std::move(pipeline));
+    } else if (expect) {
+      script.Incomplete = true;
+      return fail("unexpected end of line");
+    }
+    return true;
+  }
+  // Expands one word: quotes and escapes are removed, variables, $?, the
+  // positional parameters and a leading ~ are substituted, "$@" gives one
+  // field per parameter, unquoted expansions are split on blanks and
+  // unquoted glob patterns are matched against the file system. Variables
+  // are looked up in 'env'. Appends the resulting fields to out. With
+  // 'fields' false, as for the value of an assignment, there is no splitting
+  // or globbing and exactly one field.
+  static auto Expand(const std::string &raw, int status,
+                     const Environment &env, std::vector<std::string> &out,
+                     bool fields = true) -> void {
+    std::string value;
+    std::string pattern;
+    bool glob = false;
+    bool quoted = false;
+    bool any = false;
+    /* Set by a "$@" that had no parameters to give. */
+    bool none = false;
+    char quote = 0;
+    auto field = [&]() {
+      if (!any && (!quoted || none) && fields) {
+        none = false;
+        return;
+      }
+      glob = glob && fields;
+      glob_t g{};
+      if (glob && ::glob(pattern.c_str(), 0, nullptr, &g) == 0) {
+        for (size_t n = 0; n < g.gl_pathc; n++) {
+          out.emplace_back(g.gl_pathv[n]);
+        }
+      } else {
+        out.push_back(value);
+      }
+      if (glob) {
+        globfree(&g);
+      }
+      value.clear();
+      pattern.clear();
+      glob = quoted = any = none = false;
+    };
+    auto literal = [&](char c, bool escaped) {
+      value += c;
+      if (escaped && (c == '*' || c == '?' || c == '[' || c == '\\')) {
+        pattern += '\\';
+      } else if (!escaped && (c == '*' || c == '?' || c == '[')) {
+        glob = true;
+      }
+      pattern += c;
+      any = true;
+    };
+    size_t i = 0;
+    if (raw.size() > 0 && raw[0] == '~' &&
+        (raw.size() == 1 || raw[1] == '/')) {
+      const char *home = env.Get("HOME");
+      for (const char *h = (home != nullptr) ? home : "~"; *h != 0; h++) {
+        literal(*h, true);
+      }
+      i = 1;
+    }
+    while (i < raw.size()) {
+      char const c = raw[i];
+      if (quote == '\'') {
+        if (c == '\'') {
+          quote = 0;
+        } else {
+          literal(c, true);
+        }
+        i++;
+      } else if (c == '\'' && quote == 0) {
+        quote = '\'';
+        quoted = true;
+        i++;
+      } else if (c == '"') {
+        quote = (quote == 0) ? '"' : 0;
+        quoted = true;
+        i++;
+      } else if (c == '\\' && i + 1 < raw.size()) {
+        char const next = raw[i + 1];
+        if (quote == '"' && next != '"' && next != '\\' && next != '$') {
+          literal(c, true);
+        }
+        literal(next, true);
+        i += 2;
+      } else if (c == '$' && quote == '"' && fields && i + 1 < raw.size() &&
+                 raw[i + 1] == '@') {
+        auto const &params = env.Params();
+        for (size_t n = 1; n < params.size(); n++) {
+          if (n > 1) {
+            field();
+            quoted = true;
+          }
+          for (char const e : params[n]) {
+            literal(e, true);
+          }
+        }
+        none = params.size() < 2;
+        i += 2;
+      } else if (c == '$') {
+        std::string expanded;
+        ExpandVar(raw, i, status, env, expanded);
+        for (char const e : expanded) {
+          if (quote == 0 && fields && IsBlank(e)) {
+            field();
+          } else {
+            literal(e, quote != 0);
+          }
+        }
+      } else {
+        literal(c, quote != 0);
+        i++;
+      }
+    }
+    field();
+  }
+};
+} // namespace Origin
+#endif // PARSER_HPP
@@ -0,0 +1,162 @@
+#ifndef PATHCACHE_HPP
+#define PATHCACHE_HPP
+#include "pathdirs.hpp"
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+namespace Origin {
+/* Remembers where each command was found in $PATH, like the 'hash' built-in
+of other shells but without having to be told when to forget. posix_spawnp
+tries every directory before the one holding the command, so a command in
+/usr/bin costs an execve() per earlier directory on each start; a name found
+here is started by its full path instead, with no search at all. The cache
+follows the shared PathDirs watches: every entry is dropped once anything in
+a $PATH directory is added, removed, renamed or has its mode changed, so
+pending events are read before each lookup and a hit makes no system call
+beyond that read. Directories without a watch, such as ones that do not
+exist yet, are checked by modification time instead, but only those searched
+before the one the command is in. A changed $PATH starts the cache afresh.
+Names that are not found, those found in a relative directory, which depends
+on the working directory, and those looked up under another $PATH than the
+shell's are not kept. Shared() is used from the main thread only. */
+struct PathCache {
+private:
+  struct Entry {
+    std::string File;
+    /* Index of the directory it was found in. */
+    size_t Dir{0};
+  };
+  PathDirs *Paths{&PathDirs::Shared()};
+  /* The list and changes of Paths the entries were found under, and the
+  modification time of each directory when resolving began. */
+  uint64_t List{0};
+  uint64_t Changes{0};
+  std::vector<timespec> Mtimes;
+  std::unordered_map<std::string, Entry> Found;
+  /* The answer for a name that is not kept. */
+  std::string Last;
+
+  static auto ReadMtime(const std::string &path) -> timespec {
+    struct stat st {};
+    return (stat(path.c_str(), &st) == 0) ? st.st_mtim : timespec{0, 0};
+  }
+  static auto IsSame(const timespec &a, const timespec &b) -> bool {
+    return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+  }
+  // Returns true if 'file' is an executable regular file.
+  static auto IsCommand(const std::string &file) -> bool {
+    struct stat st {};
+    return stat(file.c_str(), &st) == 0 && S_ISREG(st.st_mode) &&
+           access(file.c_str(), X_OK) == 0;
+  }
+  // Returns 'file' with a slash, so posix_spawnp() does not search again.
+  static auto Anchor(std::string file) -> std::string {
+    return (file[0] == '/') ? file : "./" + file;
+  }
+  // Returns true if no directory without a watch, up to and including
+  // 'last', has changed since resolving began.
+  auto IsCurrent(size_t last) const -> bool {
+    auto const &dirs = Paths->GetDirs();
+    for (size_t i = 0; i <= last && i < dirs.size(); i++) {
+      if (dirs[i].Watch == -1 && !dirs[i].Relative &&
+          !IsSame(ReadMtime(dirs[i].Path), Mtimes[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+  // Searches the directories in order for an executable regular file.
+  auto Resolve(const std::string &name, Entry &entry) const -> bool {
+    auto const &dirs = Paths->GetDirs();
+    for (size_t i = 0; i < dirs.size(); i++) {
+      std::string file =
+          dirs[i].Path.empty() ? name : dirs[i].Path + "/" + name;
+      if (IsCommand(file)) {
+        entry.File = Anchor(std::move(file));
+        entry.Dir = i;
+        return true;
+      }
+    }
+    return false;
+  }
+  // Searches 'path' for 'name' without the cache.
+  auto Search(const std::string &name, std::string_view path)
+      -> const std::string * {
+    size_t start = 0;
+    while (start <= path.size()) {
+      size_t end = path.find(':', start);
+      end = (end == std::string_view::npos) ? path.size() : end;
+      std::string file(path.substr(start, end - start));
+      file += file.empty() ? name : "/" + name;
+      start = end + 1;
+      if (IsCommand(file)) {
+        Last = Anchor(std::move(file));
+        return &Last;
+      }
+    }
+    return nullptr;
+  }
+
+public:
+  static auto Shared() -> PathCache & {
+    static PathCache cache;
+    return cache;
+  }
+  // Returns the file that 'name', which holds no slash, runs from under
+  // 'path', or nullptr if it was not found. The pointer is valid until the
+  // next call.
+  auto Find(const std::string &name, std::string_view path)
+      -> const std::string * {
+    Paths->Update();
+    Paths->Poll();
+    if (path != Paths->GetPath()) {
+      return Search(name, path);
+    }
+    auto const &dirs = Paths->GetDirs();
+    if (List != Paths->GetList()) {
+      List = Paths->GetList();
+      Mtimes.assign(dirs.size(), timespec{0, 0});
+      Found.clear();
+    }
+    if (Changes != Paths->GetChanges()) {
+      Changes = Paths->GetChanges();
+      Found.clear();
+    }
+    auto const it = Found.find(name);
+    if (it != Found.end()) {
+      if (IsCurrent(it->second.Dir)) {
+        return &it->second.File;
+      }
+      Found.clear();
+    }
+    // Times are taken before searching, so a change made meanwhile is seen
+    // next time, and any change drops what was found before it.
+    for (size_t i = 0; i < dirs.size(); i++) {
+      if (dirs[i].Watch == -1 && !dirs[i].Relative) {
+        timespec const now = ReadMtime(dirs[i].Path);
+        if (!IsSame(now, Mtimes[i])) {
+          Found.clear();
+          Mtimes[i] = now;
+        }
+      }
+    }
+    Entry entry;
+    if (!Resolve(name, entry)) {
+      return nullptr;
+    }
+    for (size_t i = 0; i <= entry.Dir; i++) {
+      if (dirs[i].Relative) {
+        Last = std::move(entry.File);
+        return &Last;
+      }
+    }
+    return &Found.emplace(name, std::move(entry)).first->second.File;
+  }
+};
+} // namespace Origin
+#endif // PATHCACHE_HPP
@@ -0,0 +1,133 @@
+#ifndef PATHDIRS_HPP
+#define PATHDIRS_HPP
+#include "env.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <vector>
+namespace Origin {
+/* The directories of the shell's $PATH in search order, each watched with
+inotify. The completer's index of command names and the cache of command paths
+both follow them, so the shell holds one set of watches and both see the same
+events. Poll() reads pending events and counts the changes to each directory;
+a user keeps the counts it last saw and compares them to learn what changed,
+as several users read the one descriptor. The list is rebuilt by Update() once
+$PATH changes, which bumps GetList(). A directory without a watch, because it
+is relative, does not exist, the watch limit was reached or it was removed or
+moved, has a Watch of -1 and must be checked by other means. If there is no
+inotify instance at all no directory is watched. Used from the main thread. */
+struct PathDirs {
+  struct Dir {
+    std::string Path;
+    int Watch{-1};
+    /* An empty or relative entry, which depends on the working directory. */
+    bool Relative{false};
+    /* Events seen for the directory since the list was built. */
+    uint64_t Changes{0};
+  };
+
+private:
+  static constexpr uint32_t WatchMask =
+      IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB |
+      IN_DELETE_SELF | IN_MOVE_SELF;
+  int Notify{-1};
+  std::string PathVar;
+  bool Built{false};
+  std::vector<Dir> Dirs;
+  /* Builds of the list, and changes to any directory. */
+  uint64_t List{0};
+  uint64_t Changes{0};
+
+  // Reads pending events, counting them against the directories they name
+  // when 'count' is true and discarding them otherwise.
+  auto Drain(bool count) -> void {
+    alignas(inotify_event) char buf[4096];
+    ssize_t n;
+    while (Notify != -1 && (n = read(Notify, buf, sizeof(buf))) > 0) {
+      for (ssize_t at = 0; at < n && count;) {
+        auto const *event = reinterpret_cast<const inotify_event *>(buf + at);
+        at += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+        // An overflowed queue may have lost events for any directory.
+        bool const all = (event->mask & IN_Q_OVERFLOW) != 0;
+        for (auto &dir : Dirs) {
+          if (!all && (dir.Watch == -1 || dir.Watch != event->wd)) {
+            continue;
+          }
+          dir.Changes++;
+          Changes++;
+          // A moved directory is no longer at its path, and one that was
+          // removed has lost its watch.
+          if (!all && (event->mask & IN_MOVE_SELF) != 0) {
+            inotify_rm_watch(Notify, dir.Watch);
+          }
+          if (!all && (event->mask & (IN_MOVE_SELF | IN_IGNORED)) != 0) {
+            dir.Watch = -1;
+          }
+        }
+      }
+    }
+  }
+
+public:
+  PathDirs() { Notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC); }
+  ~PathDirs() {
+    if (Notify != -1) {
+      close(Notify);
+    }
+  }
+  PathDirs(const PathDirs &) = delete;
+  auto operator=(const PathDirs &) -> PathDirs & = delete;
+  static auto Shared() -> PathDirs & {
+    static PathDirs dirs;
+    return dirs;
+  }
+  // Rebuilds the list and its watches if $PATH changed since the last call.
+  // Returns true if it did.
+  auto Update() -> bool {
+    const char *path = Environment::Shell().Get("PATH");
+    std::string_view const now = (path != nullptr) ? path : "";
+    if (Built && now == PathVar) {
+      return false;
+    }
+    for (auto const &dir : Dirs) {
+      if (dir.Watch != -1) {
+        inotify_rm_watch(Notify, dir.Watch);
+      }
+    }
+    Dirs.clear();
+    // Events still queued, including those for the removed watches, name
+    // directories of the old list.
+    Drain(false);
+    Built = true;
+    PathVar = now;
+    List++;
+    size_t start = 0;
+    while (start <= PathVar.size()) {
+      size_t end = PathVar.find(':', start);
+      end = (end == std::string::npos) ? PathVar.size() : end;
+      Dir entry;
+      entry.Path = PathVar.substr(start, end - start);
+      start = end + 1;
+      entry.Relative = entry.Path.empty() || entry.Path[0] != '/';
+      if (!entry.Relative && Notify != -1) {
+        entry.Watch = inotify_add_watch(Notify, entry.Path.c_str(), WatchMask);
+      }
+      Dirs.push_back(entry);
+    }
+    return true;
+  }
+  // Reads pending events and counts the changes they report.
+  auto Poll() -> void { Drain(true); }
+  auto GetDirs() const -> const std::vector<Dir> & { return Dirs; }
+  // Returns the $PATH the list was built from.
+  auto GetPath() const -> const std::string & { return PathVar; }
+  auto GetList() const -> uint64_t { return List; }
+  auto GetChanges() const -> uint64_t { return Changes; }
+  // Returns the inotify descriptor, readable when a directory changed, or -1
+  // if there is none.
+  auto GetFd() const -> int { return Notify; }
+};
+} // namespace Origin
+#endif // PATHDIRS_HPP
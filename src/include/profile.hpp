@@ -0,0 +1,250 @@
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+#include "timer.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+namespace Origin {
+/* Records how long each stage of the shell takes. Every thread that records
+gets its own set of histograms, so the hot path is a few relaxed atomic adds on
+memory no other thread writes, and no locks are taken. Buckets are
+log-linear: eight buckets per power of two, which keeps percentiles within
+about 12% of the true value from nanoseconds up to minutes. */
+struct Profile {
+  static const int InputStage = 0, DispatchStage = 1, ExecStage = 2,
+                   TextStage = 3, WriteStage = 4, GuiStage = 5,
+                   StageCount = 6;
+  static inline const char *StageNames[StageCount] = {
+      "input", "dispatch", "exec", "text", "write", "gui"};
+  /* Percentiles and totals for one stage, in nanoseconds. */
+  struct Summary {
+    uint64_t Count{0};
+    uint64_t Mean{0};
+    uint64_t P50{0};
+    uint64_t P99{0};
+    uint64_t Max{0};
+  };
+
+private:
+  static const int SubBits = 3;
+  static const int BucketCount = 64 << SubBits;
+  static const int MaxThreads = 8;
+  struct Histogram {
+    std::atomic<uint64_t> Buckets[BucketCount];
+    std::atomic<uint64_t> Count;
+    std::atomic<uint64_t> Sum;
+    std::atomic<uint64_t> Max;
+  };
+  /* Slot MaxThreads is shared by any threads past the first MaxThreads. */
+  static inline Histogram Slots[MaxThreads + 1][StageCount];
+  static inline std::atomic<int> NextSlot{0};
+
+  static auto Bucket(uint64_t ns) -> int {
+    if (ns < (1u << SubBits)) {
+      return static_cast<int>(ns);
+    }
+    int const msb = 63 - __builtin_clzll(ns);
+    int const sub = static_cast<int>((ns >> (msb - SubBits)) &
+                                     ((1u << SubBits) - 1));
+    return ((msb - SubBits + 1) << SubBits) + sub;
+  }
+  // Returns the upper bound of a bucket, the value reported for it.
+  static auto BucketLimit(int bucket) -> uint64_t {
+    if (bucket < (1 << SubBits)) {
+      return static_cast<uint64_t>(bucket);
+    }
+    int const msb = (bucket >> SubBits) + SubBits - 1;
+    uint64_t const sub = static_cast<uint64_t>(bucket & ((1 << SubBits) - 1));
+    return ((uint64_t(1) << msb) | (sub << (msb - SubBits))) +
+           (uint64_t(1) << (msb - SubBits)) - 1;
+  }
+  static auto ThreadSlot() -> Histogram * {
+    thread_local int slot = -1;
+    if (slot == -1) {
+      slot = NextSlot.fetch_add(1, std::memory_order_relaxed);
+      if (slot > MaxThreads) {
+        slot = MaxThreads;
+      }
+    }
+    return Slots[slot];
+  }
+
+public:
+  /* Times the enclosing scope and records it against a stage. */
+  struct Scope {
+    int Stage;
+    nanoseconds Start;
+    explicit Scope(int stage) : Stage(stage), Start(Timer::GetNow()) {}
+    ~Scope() { Record(Stage, Timer::GetNow() - Start); }
+    Scope(const Scope &) = delete;
+    auto operator=(const Scope &) -> Scope & = delete;
+  };
+  // Adds one sample to the calling thread's histogram for a stage.
+  static auto Record(int stage, nanoseconds time) -> void {
+    uint64_t const ns =
+        static_cast<uint64_t>(time.count() > 0 ? time.count() : 0);
+    Histogram &h = ThreadSlot()[stage];
+    h.Buckets[Bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+    h.Count.fetch_add(1, std::memory_order_relaxed);
+    h.Sum.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t max = h.Max.load(std::memory_order_relaxed);
+    while (ns > max && !h.Max.compare_exchange_weak(
+                           max, ns, std::memory_order_relaxed)) {
+    }
+  }
+  // Merges every thread's histogram for a stage into a summary.
+  static auto Summarize(int stage) -> Summary {
+    uint64_t merged[BucketCount] = {};
+    Summary sum;
+    uint64_t total = 0;
+    for (auto &slot : Slots) {
+      Histogram &h = slot[stage];
+      for (int b = 0; b < BucketCount; b++) {
+        merged[b] += h.Buckets[b].load(std::memory_order_relaxed);
+      }
+      sum.Count += h.Count.load(std::memory_order_relaxed);
+      total += h.Sum.load(std::memory_order_relaxed);
+      uint64_t const max = h.Max.load(std::memory_order_relaxed);
+      sum.Max = (max > sum.Max) ? max : sum.Max;
+    }
+    if (sum.Count == 0) {
+      return sum;
+    }
+    sum.Mean = total / sum.Count;
+    uint64_t const p50 = (sum.Count + 1) / 2;
+    uint64_t const p99 = sum.Count - sum.Count / 100;
+    uint64_t seen = 0;
+    for (int b = 0; b < BucketCount; b++) {
+      if (seen < p50 && seen + merged[b] >= p50) {
+        sum.P50 = BucketLimit(b);
+      }
+      if (seen < p99 && seen + merged[b] >= p99) {
+        sum.P99 = BucketLimit(b);
+      }
+      seen += merged[b];
+    }
+    sum.P50 = (sum.P50 < sum.Max) ? sum.P50 : sum.Max;
+    sum.P99 = (sum.P99 < sum.Max) ? sum.P99 : sum.Max;
+    return sum;
+  }
+  // Clears every histogram. Samples recorded concurrently may be lost.
+  static auto Reset() -> void {
+    for (auto &slot : Slots) {
+      for (Histogram &h : slot) {
+        for (auto &b : h.Buckets) {
+          b.store(0, std::memory_order_relaxed);
+        }
+        h.Count.store(0, std::memory_order_relaxed);
+        h.Sum.store(0, std::memory_order_relaxed);
+        h.Max.store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+  // Formats all stages as a table with times in microseconds.
+  static auto Table() -> std::string {
+    char line[128];
+    std::string out = "stage         count    mean(us)     p50(us)     "
+                      "p99(us)     max(us)\n";
+    for (int i = 0; i < StageCount; i++) {
+      Summary const s = Summarize(i);
+      snprintf(line, sizeof(line), "%-9s %9llu %11.1f %11.1f %11.1f %11.1f\n",
+               StageNames[i], static_cast<unsigned long long>(s.Count),
+               s.Mean / 1000.0, s.P50 / 1000.0, s.P99 / 1000.0,
+               s.Max / 1000.0);
+      out += line;
+    }
+    return out;
+  }
+  // Formats all stages as one line of JSON with times in nanoseconds.
+  static auto Json() -> std::string {
+    char line[192];
+    std::string out = "{";
+    for (int i = 0; i < StageCount; i++) {
+      Summary const s = Summarize(i);
+      snprintf(line, sizeof(line),
+               "%s\"%s\":{\"count\":%llu,\"mean_ns\":%llu,\"p50_ns\":%llu,"
+               "\"p99_ns\":%llu,\"max_ns\":%llu}",
+               (i > 0) ? "," : "", StageNames[i],
+               static_cast<unsigned long long>(s.Count),
+               static_cast<unsigned long long>(s.Mean),
+               static_cast<unsigned long long>(s.P50),
+               static_cast<unsigned long long>(s.P99),
+               static_cast<unsigned long long>(s.Max));
+      out += line;
+    }
+    return out + "}\n";
+  }
+};
+/* Times the phases of startup for --startup-profile. Each Mark() closes the
+phase that began at the previous mark, or at Begin(), so the phases add up to
+the time from main() to the mark. Marks are only taken by the main thread,
+and nothing is recorded unless Begin() was called. */
+struct Startup {
+private:
+  static const int MaxPhases = 24;
+  static inline bool Enabled{false};
+  static inline int Count{0};
+  static inline nanoseconds Began{nanoseconds::zero()};
+  static inline nanoseconds Last{nanoseconds::zero()};
+  static inline const char *Names[MaxPhases];
+  static inline nanoseconds Times[MaxPhases];
+
+public:
+  // Starts recording; the first phase begins now.
+  static auto Begin() -> void {
+    Enabled = true;
+    Count = 0;
+    Began = Last = Timer::GetNow();
+  }
+  static auto IsEnabled() -> bool { return Enabled; }
+  // Ends the current phase at 'now' and records it under 'name'.
+  static auto Mark(const char *name, nanoseconds now = Timer::GetNow())
+      -> void {
+    if (!Enabled || Count == MaxPhases) {
+      return;
+    }
+    Names[Count] = name;
+    Times[Count++] = (now > Last) ? now - Last : nanoseconds::zero();
+    Last = (now > Last) ? now : Last;
+  }
+  // Formats the phases as a table with times in microseconds.
+  static auto Table() -> std::string {
+    char line[96];
+    std::string out = "phase             time(us)    total(us)\n";
+    nanoseconds total = nanoseconds::zero();
+    for (int i = 0; i < Count; i++) {
+      total += Times[i];
+      snprintf(line, sizeof(line), "%-14s %11.1f %12.1f\n", Names[i],
+               Times[i].count() / 1000.0, total.count() / 1000.0);
+      out += line;
+    }
+    return out;
+  }
+  // Formats the phases as one line of JSON with times in nanoseconds.
+  static auto Json() -> std::string {
+    char line[96];
+    std::string out = "{";
+    for (int i = 0; i < Count; i++) {
+      snprintf(line, sizeof(line), "%s\"%s\":%lld", (i > 0) ? "," : "",
+               Names[i], static_cast<long long>(Times[i].count()));
+      out += line;
+    }
+    snprintf(line, sizeof(line), "%s\"total\":%lld}\n",
+             (Count > 0) ? "," : "",
+             static_cast<long long>((Last - Began).count()));
+    return out + line;
+  }
+  // Writes the JSON form to 'path'. Returns false if it cannot be written.
+  static auto Save(const std::string &path) -> bool {
+    FILE *file = fopen(path.c_str(), "w");
+    if (file == nullptr) {
+      return false;
+    }
+    std::string const json = Json();
+    bool const ok = fwrite(json.data(), 1, json.size(), file) == json.size();
+    return fclose(file) == 0 && ok;
+  }
+};
+} // namespace Origin
+#endif // PROFILE_HPP
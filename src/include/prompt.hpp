@@ -0,0 +1,349 @@
+#ifndef PROMPT_HPP
+#define PROMPT_HPP
+#include "env.hpp"
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <spawn.h>
+#include <stdexcept>
+#include <string>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+namespace Origin {
+/* The prompt before the input: who and where the shell is, the git branch of
+the working directory, the number of background jobs and the last foreground
+exit status. Each segment is kept until something invalidates it, so building
+a frame never makes a system call: the user and host are read once, the
+directory when 'cd' changes it, and the jobs and status are handed in by the
+main loop. The git segment can take seconds in a large repository, so a worker
+thread computes it and the prompt shows the previous value until the new one
+arrives, when the worker signals a descriptor the main loop waits on. The
+worker only starts on the first request, so it costs nothing at startup. */
+struct Prompt {
+private:
+  std::string User;
+  std::string Host;
+  std::string Home;
+  std::string Cwd;
+  std::string Git;
+  size_t JobCount{0};
+  int Status{0};
+  /* The assembled text, rebuilt when a segment changed. */
+  std::string Text;
+  bool Stale{true};
+  /* Requests and results passed between the main thread and the worker under
+  Lock. A request holds the directory and a copy of the environment, as the
+  main thread may change its own while git runs; only the latest is kept. */
+  std::mutex Lock;
+  std::condition_variable Wake;
+  bool Requested{false};
+  bool Stopping{false};
+  std::string RequestDir;
+  std::vector<std::string> RequestEnv;
+  bool Answered{false};
+  std::string Answer;
+  /* The git process the worker waits for, killed if the shell exits first. */
+  pid_t Child{-1};
+  std::thread Worker;
+  int Notify{-1};
+
+  // Returns the directory holding '.git' at or above 'dir', with 'gitdir'
+  // set to the repository itself, or an empty string outside a repository.
+  static auto FindRepo(std::string dir, std::string &gitdir) -> std::string {
+    while (!dir.empty()) {
+      std::string const dot = dir + ((dir == "/") ? ".git" : "/.git");
+      struct stat st {};
+      if (stat(dot.c_str(), &st) == 0) {
+        gitdir = dot;
+        // A worktree or submodule has a file naming the repository instead.
+        std::string link;
+        if (S_ISREG(st.st_mode) && ReadFile(dot, link) &&
+            link.compare(0, 8, "gitdir: ") == 0) {
+          gitdir = link.substr(8, link.find('\n') - 8);
+          if (!gitdir.empty() && gitdir[0] != '/') {
+            gitdir = dir + "/" + gitdir;
+          }
+        }
+        return dir;
+      }
+      if (dir == "/") {
+        break;
+      }
+      size_t const slash = dir.rfind('/');
+      dir = (slash == 0) ? "/" : dir.substr(0, slash);
+    }
+    return "";
+  }
+  // Reads the working directory. Returns true if it changed.
+  auto ReadCwd() -> bool {
+    char cwd[4096];
+    std::string const dir = (getcwd(cwd, sizeof(cwd)) != nullptr) ? cwd : "?";
+    if (dir == Cwd) {
+      return false;
+    }
+    Cwd = dir;
+    Stale = true;
+    return true;
+  }
+  // Reads up to the first 256 bytes of a file into 'out'.
+  static auto ReadFile(const std::string &path, std::string &out) -> bool {
+    int const fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+      return false;
+    }
+    char buf[256];
+    ssize_t const n = read(fd, buf, sizeof(buf));
+    close(fd);
+    out.assign(buf, static_cast<size_t>((n > 0) ? n : 0));
+    return n > 0;
+  }
+  // Returns the branch checked out in a repository, or the start of the
+  // commit id when the head is detached.
+  static auto Branch(const std::string &gitdir) -> std::string {
+    std::string head;
+    if (!ReadFile(gitdir + "/HEAD", head)) {
+      return "";
+    }
+    head = head.substr(0, head.find('\n'));
+    if (head.compare(0, 16, "ref: refs/heads/") == 0) {
+      return head.substr(16);
+    }
+    return head.substr(0, 7);
+  }
+  // Returns the path of 'name' in the $PATH of 'env', or an empty string.
+  static auto Which(const std::vector<std::string> &env, const char *name)
+      -> std::string {
+    std::string path = "/usr/bin:/bin";
+    for (auto const &var : env) {
+      if (var.compare(0, 5, "PATH=") == 0) {
+        path = var.substr(5);
+      }
+    }
+    size_t start = 0;
+    while (start <= path.size()) {
+      size_t end = path.find(':', start);
+      end = (end == std::string::npos) ? path.size() : end;
+      std::string const file = path.substr(start, end - start) + "/" + name;
+      if (end > start && access(file.c_str(), X_OK) == 0) {
+        return file;
+      }
+      start = end + 1;
+    }
+    return "";
+  }
+  // Runs 'git status' on the tracked files of a work tree. Returns true if
+  // any of them changed; a missing or failing git counts as clean.
+  auto IsDirty(const std::string &root, std::vector<std::string> &env)
+      -> bool {
+    std::string const git = Which(env, "git");
+    int link[2];
+    if (git.empty() || pipe2(link, O_CLOEXEC) != 0) {
+      return false;
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null",
+                                     O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, link[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null",
+                                     O_WRONLY, 0);
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t none;
+    sigemptyset(&none);
+    posix_spawnattr_setsigmask(&attr, &none);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+    std::vector<std::string> args = {git, "--no-optional-locks", "-C", root,
+                                     "status", "--porcelain", "-uno",
+                                     "--ignore-submodules=dirty"};
+    std::vector<char *> argv;
+    for (auto &arg : args) {
+      argv.push_back(&arg[0]);
+    }
+    argv.push_back(nullptr);
+    std::vector<char *> envp;
+    for (auto &var : env) {
+      envp.push_back(&var[0]);
+    }
+    envp.push_back(nullptr);
+    pid_t pid = -1;
+    int const rc = posix_spawn(&pid, git.c_str(), &actions, &attr,
+                               argv.data(), envp.data());
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    close(link[1]);
+    if (rc != 0) {
+      close(link[0]);
+      return false;
+    }
+    {
+      std::lock_guard<std::mutex> const hold(Lock);
+      Child = pid;
+      if (Stopping) {
+        kill(pid, SIGTERM);
+      }
+    }
+    // Any line of output is a changed file; the rest is drained unread.
+    bool changed = false;
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(link[0], buf, sizeof(buf))) != 0) {
+      if (n < 0 && errno != EINTR) {
+        break;
+      }
+      changed = changed || n > 0;
+    }
+    close(link[0]);
+    int status = 0;
+    while (waitpid(pid, &status, 0) == -1 && errno == EINTR) {
+    }
+    std::lock_guard<std::mutex> const hold(Lock);
+    Child = -1;
+    return changed && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  }
+  // Computes the git segment for each request until the prompt is destroyed.
+  // A result is dropped if a newer request came in while it was computed.
+  auto Work() -> void {
+    std::unique_lock<std::mutex> hold(Lock);
+    while (true) {
+      Wake.wait(hold, [this]() { return Requested || Stopping; });
+      if (Stopping) {
+        return;
+      }
+      Requested = false;
+      std::string const dir = RequestDir;
+      std::vector<std::string> env = RequestEnv;
+      hold.unlock();
+      std::string gitdir;
+      std::string const root = FindRepo(dir, gitdir);
+      std::string segment;
+      if (!root.empty()) {
+        segment = Branch(gitdir);
+        if (!segment.empty() && IsDirty(root, env)) {
+          segment += '*';
+        }
+      }
+      hold.lock();
+      if (!Requested) {
+        Answer = segment;
+        Answered = true;
+        uint64_t const one = 1;
+        ssize_t const n = write(Notify, &one, sizeof(one));
+        static_cast<void>(n);
+      }
+    }
+  }
+
+public:
+  Prompt() {
+    Notify = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (Notify == -1) {
+      throw std::runtime_error("eventfd() failed!");
+    }
+    const char *user = cuserid(nullptr);
+    User = (user != nullptr) ? user : "";
+    char host[256] = {0};
+    gethostname(host, sizeof(host) - 1);
+    Host = host;
+    const char *home = Environment::Shell().Get("HOME");
+    Home = (home != nullptr) ? home : "";
+    ReadCwd();
+  }
+  ~Prompt() {
+    {
+      std::lock_guard<std::mutex> const hold(Lock);
+      Stopping = true;
+      if (Child > 0) {
+        kill(Child, SIGTERM);
+      }
+    }
+    Wake.notify_one();
+    if (Worker.joinable()) {
+      Worker.join();
+    }
+    close(Notify);
+  }
+  Prompt(const Prompt &) = delete;
+  auto operator=(const Prompt &) -> Prompt & = delete;
+  // Rereads the working directory after 'cd' and, if it changed, asks for
+  // its git state.
+  auto SetCwd() -> void {
+    if (ReadCwd()) {
+      Refresh();
+    }
+  }
+  // Asks the worker to recompute the git segment, as a finished command may
+  // have changed the work tree. The current one is shown meanwhile.
+  auto Refresh() -> void {
+    {
+      std::lock_guard<std::mutex> const hold(Lock);
+      Requested = true;
+      RequestDir = Cwd;
+      RequestEnv = Environment::Shell().List();
+    }
+    if (!Worker.joinable()) {
+      Worker = std::thread([this]() { Work(); });
+    }
+    Wake.notify_one();
+  }
+  // Takes the git segment the worker computed. Call when GetFd() is readable.
+  auto Collect() -> void {
+    uint64_t count = 0;
+    while (read(Notify, &count, sizeof(count)) > 0) {
+    }
+    std::lock_guard<std::mutex> const hold(Lock);
+    if (Answered && Answer != Git) {
+      Git = Answer;
+      Stale = true;
+    }
+    Answered = false;
+  }
+  auto SetJobs(size_t count) -> void {
+    Stale = Stale || count != JobCount;
+    JobCount = count;
+  }
+  auto SetStatus(int status) -> void {
+    Stale = Stale || status != Status;
+    Status = status;
+  }
+  // Returns the prompt up to the input, which follows in brackets.
+  auto GetText() -> const std::string & {
+    if (!Stale) {
+      return Text;
+    }
+    Stale = false;
+    Text = ">-(" + User + "@" + Host + ")-[";
+    if (!Home.empty() && Cwd.compare(0, Home.size(), Home) == 0 &&
+        (Cwd.size() == Home.size() || Cwd[Home.size()] == '/')) {
+      Text += "~" + Cwd.substr(Home.size());
+    } else {
+      Text += Cwd;
+    }
+    Text += "]-";
+    if (!Git.empty()) {
+      Text += "(" + Git + ")-";
+    }
+    if (JobCount > 0) {
+      Text += "{" + std::to_string(JobCount) + " jobs}-";
+    }
+    if (Status != 0) {
+      Text += "(exit " + std::to_string(Status) + ")-";
+    }
+    Text += "$ ";
+    return Text;
+  }
+  // Returns the descriptor that becomes readable when a git segment is ready.
+  auto GetFd() const -> int { return Notify; }
+};
+} // namespace Origin
+#endif // PROMPT_HPP
@@ -0,0 +1,74 @@
+#ifndef RING_HPP
+#define RING_HPP
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+namespace Origin {
+/* A fixed-capacity byte ring used to hold command output. Writes never block
+and never grow the buffer: once it is full the oldest bytes are overwritten, so
+memory use stays flat no matter how much a command prints. */
+struct Ring {
+private:
+  std::vector<char> Data;
+  uint64_t Head{0};
+  size_t Capacity{0};
+
+public:
+  Ring(size_t capacity = 1 << 20) : Data(capacity), Capacity(capacity) {}
+  // Appends len bytes, discarding the oldest data once the ring is full.
+  auto Write(const char *src, size_t len) -> size_t {
+    size_t const written = len;
+    if (len > Capacity) {
+      Head += len - Capacity;
+      src += len - Capacity;
+      len = Capacity;
+    }
+    size_t const at = Head % Capacity;
+    size_t const first = (len < Capacity - at) ? len : Capacity - at;
+    std::memcpy(Data.data() + at, src, first);
+    std::memcpy(Data.data(), src + first, len - first);
+    Head += len;
+    return written;
+  }
+  // Returns the number of bytes currently held.
+  auto Size() const -> size_t {
+    return (Head < Capacity) ? static_cast<size_t>(Head) : Capacity;
+  }
+  // Returns the total number of bytes ever written, including dropped ones.
+  auto Written() const -> uint64_t { return Head; }
+  // Returns the number of bytes that have been overwritten.
+  auto Dropped() const -> uint64_t { return Head - Size(); }
+  auto GetCapacity() const -> size_t { return Capacity; }
+  auto Clear() -> void { Head = 0; }
+  // Returns the byte at a given offset from the oldest byte held.
+  auto At(size_t i) const -> char {
+    return Data[(Head - Size() + i) % Capacity];
+  }
+  // Copies the last 'lines' lines into out, replacing its contents. Only the
+  // tail is scanned, so the cost depends on what is shown rather than on how
+  // much output has been buffered.
+  auto Tail(std::string &out, size_t lines) const -> size_t {
+    size_t const size = Size();
+    size_t start = size;
+    size_t found = 0;
+    if (start > 0 && At(start - 1) == '\n') {
+      start--;
+    }
+    while (start > 0) {
+      if (At(start - 1) == '\n' && ++found >= lines) {
+        break;
+      }
+      start--;
+    }
+    size_t const from = (Head - size + start) % Capacity;
+    size_t const len = size - start;
+    size_t const first = (len < Capacity - from) ? len : Capacity - from;
+    out.assign(Data.data() + from, first);
+    out.append(Data.data(), len - first);
+    return found;
+  }
+};
+} // namespace Origin
+#endif // RING_HPP
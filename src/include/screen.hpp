@@ -0,0 +1,336 @@
+#ifndef SCREEN_HPP
+#define SCREEN_HPP
+#include "cell.hpp"
+#include "console.hpp"
+#include "utf8.hpp"
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+namespace Origin {
+/* A cell grid mirroring the terminal. Each frame is laid out into the back
+buffer, while the front buffer holds what the terminal is known to show. Rows
+are only marked dirty when a cell actually changes, and Flush() emits just the
+changed spans of those rows as cursor moves plus text, with a style change
+only where consecutive cells differ in style, so an unchanged frame costs no
+terminal output at all and a changed one costs a single write(). Text is laid
+out by code point and display width, so wide characters take two cells and
+combining marks none. */
+struct Screen {
+private:
+  int Width{0};
+  int Height{0};
+  int CursorX{0};
+  int CursorY{0};
+  int LastX{-1};
+  int LastY{-1};
+  bool Cleared{false};
+  bool Moved{false};
+  std::vector<Cell> Back;
+  std::vector<Cell> Front;
+  std::vector<char> Dirty;
+  /* Text and style of the span being written by Flush(). */
+  std::string Run;
+  std::string Sgr;
+  /* Unchanged cells shorter than this between two changed spans are rewritten
+  rather than skipped, since a cursor move costs more bytes than the cells. */
+  static const int Gap = 6;
+  static const int TabWidth = 8;
+
+  // Returns true for code points that are drawn rather than dropped.
+  static auto Visible(uint32_t c) -> bool {
+    return c >= 0x20 && c != 0x7f && (c < 0x80 || c >= 0xa0);
+  }
+  // Puts code point 'c' of width 'width' at x, y: a mark goes on the cell
+  // before, and a wide character fills the cell after with WideTail.
+  auto Glyph(int x, int y, uint32_t c, int width) -> void {
+    Cell cell;
+    if (width == 0) {
+      if (x > 0) {
+        cell = Back[static_cast<size_t>(y) * Width + x - 1];
+        x -= (cell.Code == Cell::WideTail && x > 1) ? 2 : 1;
+        cell = Back[static_cast<size_t>(y) * Width + x];
+        cell.SetMark(c);
+        Put(x, y, cell);
+      }
+      return;
+    }
+    cell.Code = c;
+    Put(x, y, cell);
+    if (width == 2) {
+      cell.Code = Cell::WideTail;
+      Put(x + 1, y, cell);
+    }
+  }
+
+  // Writes a span of cells, changing style only where it changes.
+  auto Write(Console &con, const Cell *from, const Cell *to) -> void {
+    Run.clear();
+    for (const Cell *cell = from; cell != to; cell++) {
+      if (cell == from || !cell->SameStyle(cell[-1])) {
+        con.Print(Run.data(), Run.size());
+        Run.clear();
+        cell->Style(Sgr);
+        con.SetStyle(Sgr);
+      }
+      uint32_t const code = cell->Code;
+      if (code == Cell::WideTail) {
+        // Covered by the wide character before it, unless that is gone.
+        if (cell == from || Utf8::Width(cell[-1].Code) != 2) {
+          Run += ' ';
+        }
+      } else if (code < 0x80) {
+        Run += static_cast<char>(code);
+      } else {
+        Utf8::Encode(code, Run);
+      }
+      if (cell->GetMark() != 0) {
+        Utf8::Encode(cell->GetMark(), Run);
+      }
+    }
+    con.Print(Run.data(), Run.size());
+  }
+
+public:
+  Screen(int width = 80, int height = 25) { Resize(width, height); }
+  // Resizes both buffers. The next flush clears the terminal and redraws
+  // every cell, since the terminal contents are unknown after a resize.
+  auto Resize(int width, int height) -> bool {
+    if (width == Width && height == Height && !Back.empty()) {
+      return false;
+    }
+    Width = (width > 0) ? width : 1;
+    Height = (height > 0) ? height : 1;
+    size_t const size = static_cast<size_t>(Width) * Height;
+    Back.assign(size, Cell{});
+    Front.assign(size, Cell{});
+    Dirty.assign(static_cast<size_t>(Height), 1);
+    Cleared = false;
+    return true;
+  }
+  auto GetWidth() const -> int { return Width; }
+  auto GetHeight() const -> int { return Height; }
+  // Sets a single cell of the back buffer, marking its row dirty only if the
+  // cell changes.
+  inline auto Put(int x, int y, const Cell &c) -> void {
+    Cell &cell = Back[static_cast<size_t>(y) * Width + x];
+    if (cell != c) {
+      cell = c;
+      Dirty[y] = 1;
+    }
+  }
+  inline auto Put(int x, int y, char c) -> void {
+    Cell cell;
+    cell.Code = static_cast<unsigned char>(c);
+    Put(x, y, cell);
+  }
+  // Lays out text into the back buffer starting at the top left, wrapping at
+  // the right edge and blanking whatever is left over from the last frame.
+  // Control characters other than newline and tab are dropped, and a wide
+  // character that does not fit before the edge starts the next row.
+  // Returns the number of rows used.
+  auto Layout(std::string_view text) -> int {
+    int x = 0;
+    int y = 0;
+    for (size_t i = 0; i < text.size() && y < Height;) {
+      uint32_t const c = Utf8::Next(text, i);
+      int const width = Visible(c) ? Utf8::Width(c) : 0;
+      if (x + width > Width) {
+        for (; x < Width; x++) {
+          Put(x, y, ' ');
+        }
+        x = 0;
+        if (++y >= Height) {
+          break;
+        }
+      }
+      if (c == '\n') {
+        for (; x < Width; x++) {
+          Put(x, y, ' ');
+        }
+      } else if (c == '\t') {
+        int const stop = (x / TabWidth + 1) * TabWidth;
+        for (; x < stop && x < Width; x++) {
+          Put(x, y, ' ');
+        }
+      } else if (Visible(c) && width <= Width) {
+        Glyph(x, y, c, width);
+        x += width;
+      }
+      if (x >= Width) {
+        x = 0;
+        y++;
+      }
+    }
+    int const used = (x > 0) ? y + 1 : y;
+    for (; y < Height; y++) {
+      for (; x < Width; x++) {
+        Put(x, y, ' ');
+      }
+      x = 0;
+    }
+    return used;
+  }
+  // Puts one line of 'text' in each row from row 'top' on, cut at the right
+  // edge. Returns the row after the last one used.
+  auto Lines(std::string_view text, int top) -> int {
+    int x = 0;
+    int y = top;
+    for (size_t i = 0; i < text.size() && y < Height;) {
+      uint32_t const c = Utf8::Next(text, i);
+      if (c == '\n') {
+        for (; x < Width; x++) {
+          Put(x, y, ' ');
+        }
+        x = 0;
+        y++;
+      } else if (Visible(c)) {
+        int const width = Utf8::Width(c);
+        if (x + width <= Width) {
+          Glyph(x, y, c, width);
+          x += width;
+        }
+      }
+    }
+    return y;
+  }
+  // Copies rows of 'width' cells into the back buffer from row 'top' on,
+  // cut at the right edge. When they do not all fit the top ones are left
+  // out, so the newest rows stay in view.
+  auto Draw(const std::vector<Cell> &cells, int width, int top) -> void {
+    if (width <= 0 || top >= Height) {
+      return;
+    }
+    int const rows = static_cast<int>(cells.size()) / width;
+    int const skip = std::max(0, rows - (Height - top));
+    Cell const blank;
+    for (int y = top, row = skip; row < rows; y++, row++) {
+      const Cell *src = &cells[static_cast<size_t>(row) * width];
+      for (int x = 0; x < Width; x++) {
+        // A wide character cut in half by the right edge is left out.
+        bool const cut = x == Width - 1 && x + 1 < width &&
+                         src[x + 1].Code == Cell::WideTail;
+        Put(x, y, (x < width && !cut) ? src[x] : blank);
+      }
+    }
+  }
+  // Returns the cell Layout() puts byte 'offset' of 'text' in, as x and y.
+  // The offset is taken to be at the start of a character.
+  auto Locate(std::string_view text, size_t offset) const
+      -> std::pair<int, int> {
+    int x = 0;
+    int y = 0;
+    for (size_t i = 0; i < offset && i < text.size();) {
+      uint32_t const c = Utf8::Next(text, i);
+      int const width = Visible(c) ? Utf8::Width(c) : 0;
+      if (c == '\n') {
+        x = Width;
+      } else if (c == '\t') {
+        x = std::min((x / TabWidth + 1) * TabWidth, Width);
+      } else if (x + width > Width) {
+        x = width;
+        y++;
+      } else {
+        x += width;
+      }
+      if (x >= Width) {
+        x = 0;
+        y++;
+      }
+    }
+    return {x, y};
+  }
+  // Sets where the terminal cursor is left after a flush.
+  auto SetCursor(int x, int y) -> void {
+    x = (x < Width) ? x : Width - 1;
+    y = (y < Height) ? y : Height - 1;
+    if (x != CursorX || y != CursorY) {
+      CursorX = x;
+      CursorY = y;
+      Moved = true;
+    }
+  }
+  // Returns true if the next flush would write anything.
+  auto IsDirty() const -> bool {
+    if (!Cleared || Moved) {
+      return true;
+    }
+    for (char const d : Dirty) {
+      if (d != 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+  // Writes the changed spans of every dirty row to the terminal and brings
+  // the front buffer up to date. Returns the number of cells written, or 0 if
+  // the frame was skipped because nothing changed.
+  auto Flush(Console &con) -> int {
+    if (!IsDirty()) {
+      return 0;
+    }
+    int written = 0;
+    if (!Cleared) {
+      con.ClearScreen();
+      Front.assign(Front.size(), Cell{});
+      LastX = 0;
+      LastY = 0;
+      Cleared = true;
+    }
+    for (int y = 0; y < Height; y++) {
+      if (Dirty[y] == 0) {
+        continue;
+      }
+      Dirty[y] = 0;
+      Cell *back = &Back[static_cast<size_t>(y) * Width];
+      Cell *front = &Front[static_cast<size_t>(y) * Width];
+      int x = 0;
+      while (x < Width) {
+        while (x < Width && back[x] == front[x]) {
+          x++;
+        }
+        if (x >= Width) {
+          break;
+        }
+        int start = x;
+        int end = x;
+        int same = 0;
+        for (; x < Width && same < Gap; x++) {
+          if (back[x] != front[x]) {
+            end = x + 1;
+            same = 0;
+          } else {
+            same++;
+          }
+        }
+        // Whole wide characters only, so neither half is drawn alone.
+        if (start > 0 && back[start].Code == Cell::WideTail) {
+          start--;
+        }
+        if (end < Width && back[end].Code == Cell::WideTail) {
+          end++;
+        }
+        if (LastX != start || LastY != y) {
+          con.GotoXY(start + 1, y + 1);
+        }
+        Write(con, back + start, back + end);
+        std::copy(back + start, back + end, front + start);
+        written += end - start;
+        LastX = end;
+        LastY = y;
+        x = end;
+      }
+    }
+    if (LastX != CursorX || LastY != CursorY) {
+      con.GotoXY(CursorX + 1, CursorY + 1);
+      LastX = CursorX;
+      LastY = CursorY;
+    }
+    Moved = false;
+    con.Flush();
+    return (written > 0) ? written : 1;
+  }
+};
+} // namespace Origin
+#endif // SCREEN_HPP
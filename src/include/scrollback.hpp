@@ -0,0 +1,218 @@
+#ifndef SCROLLBACK_HPP
+#define SCROLLBACK_HPP
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+namespace Origin {
+/* Holds every byte of command output for scrolling back through it. Text is
+stored in fixed-size chunks, and a sparse line index records where every
+Stride'th line starts; any other line is found by scanning forward from the
+nearest mark, which keeps the index small even for millions of short lines.
+Only the newest chunks, up to the RAM limit, stay on the heap. Older chunks are
+written to an unlinked temp file and read back through a read-only mapping of
+that file, so they live in the page cache rather than in the shell's resident
+memory. If the spill file cannot be created or written, as when $TMPDIR is
+full, spilling stops and the chunks stay on the heap. Reading a window of lines
+touches only the chunks holding them. */
+struct Scrollback {
+private:
+  static constexpr size_t ChunkSize = 1 << 16;
+  /* Address space reserved for the mapping of the spill file. Output past
+  this size clears the scrollback. */
+  static constexpr size_t MapLimit = size_t(1) << 36;
+  static constexpr size_t Stride = 64;
+  /* Heap chunks, with nullptr for chunks that have been spilled. */
+  std::vector<char *> Chunks;
+  std::vector<uint64_t> Marks{0};
+  uint64_t NewLines{0};
+  uint64_t LastLine{0};
+  uint64_t Size{0};
+  size_t RamLimit{0};
+  size_t Resident{0};
+  size_t Spilled{0};
+  int File{-1};
+  char *Map{nullptr};
+  /* Set once spilling failed; chunks are then kept on the heap. */
+  bool Failed{false};
+
+  // Creates the spill file and maps it the first time a chunk is spilled.
+  // Returns false if either fails.
+  auto OpenFile() -> bool {
+    const char *dir = getenv("TMPDIR");
+    std::string path = (dir != nullptr && *dir != '\0') ? dir : "/tmp";
+    path += "/tshell-scrollback-XXXXXX";
+    File = mkstemp(&path[0]);
+    if (File == -1) {
+      return false;
+    }
+    unlink(path.c_str());
+    void *map = mmap(nullptr, MapLimit, PROT_READ, MAP_SHARED | MAP_NORESERVE,
+                     File, 0);
+    if (map == MAP_FAILED) {
+      close(File);
+      File = -1;
+      return false;
+    }
+    Map = static_cast<char *>(map);
+    return true;
+  }
+  // Writes the oldest heap chunks to the spill file until the heap is back
+  // under the RAM limit.
+  auto Spill() -> void {
+    while (!Failed && Resident * ChunkSize > RamLimit &&
+           Spilled + 1 < Chunks.size()) {
+      if (File == -1 && !OpenFile()) {
+        Failed = true;
+        return;
+      }
+      char *chunk = Chunks[Spilled];
+      off_t const at = static_cast<off_t>(Spilled * ChunkSize);
+      size_t done = 0;
+      while (done < ChunkSize) {
+        ssize_t const n = pwrite(File, chunk + done, ChunkSize - done,
+                                 at + static_cast<off_t>(done));
+        if (n <= 0) {
+          // The chunk stays on the heap, and so do all later ones.
+          Failed = true;
+          return;
+        }
+        done += static_cast<size_t>(n);
+      }
+      free(chunk);
+      Chunks[Spilled++] = nullptr;
+      Resident--;
+    }
+  }
+  auto ChunkAt(size_t index) const -> const char * {
+    return (Chunks[index] != nullptr) ? Chunks[index] : Map + index * ChunkSize;
+  }
+  // Returns the offset just past the n'th newline at or after 'at', or the
+  // end of the text if there are fewer.
+  auto SkipLines(uint64_t at, size_t n) const -> uint64_t {
+    while (n > 0 && at < Size) {
+      size_t const index = static_cast<size_t>(at / ChunkSize);
+      size_t const offset = static_cast<size_t>(at % ChunkSize);
+      size_t const len = static_cast<size_t>(
+          (Size - at < ChunkSize - offset) ? Size - at : ChunkSize - offset);
+      const char *chunk = ChunkAt(index) + offset;
+      const void *nl = memchr(chunk, '\n', len);
+      if (nl == nullptr) {
+        at += len;
+      } else {
+        at += static_cast<uint64_t>(static_cast<const char *>(nl) - chunk) + 1;
+        n--;
+      }
+    }
+    return at;
+  }
+  // Returns the offset at which a line starts.
+  auto LineStart(size_t line) const -> uint64_t {
+    return SkipLines(Marks[line / Stride], line % Stride);
+  }
+
+public:
+  Scrollback(size_t ram = 8 << 20) : RamLimit(ram) {}
+  ~Scrollback() { Clear(); }
+  Scrollback(const Scrollback &) = delete;
+  auto operator=(const Scrollback &) -> Scrollback & = delete;
+  // Appends output, indexing any line breaks in it.
+  auto Append(const char *src, size_t len) -> void {
+    if (Size + len > MapLimit) {
+      Clear();
+    }
+    for (size_t i = 0; i < len; i++) {
+      const void *nl = memchr(src + i, '\n', len - i);
+      if (nl == nullptr) {
+        break;
+      }
+      i = static_cast<size_t>(static_cast<const char *>(nl) - src);
+      LastLine = Size + i + 1;
+      if (++NewLines % Stride == 0) {
+        Marks.push_back(LastLine);
+      }
+    }
+    while (len > 0) {
+      size_t const at = static_cast<size_t>(Size % ChunkSize);
+      if (at == 0) {
+        char *chunk = static_cast<char *>(malloc(ChunkSize));
+        if (chunk == nullptr) {
+          throw std::bad_alloc();
+        }
+        Chunks.push_back(chunk);
+        Resident++;
+      }
+      size_t const n = (len < ChunkSize - at) ? len : ChunkSize - at;
+      std::memcpy(Chunks.back() + at, src, n);
+      Size += n;
+      src += n;
+      len -= n;
+    }
+    Spill();
+  }
+  auto Append(const std::string &text) -> void {
+    Append(text.data(), text.size());
+  }
+  // Returns the number of lines, counting a trailing line without a newline
+  // but not the empty line after a final newline.
+  auto LineCount() const -> size_t {
+    return static_cast<size_t>((LastLine == Size) ? NewLines : NewLines + 1);
+  }
+  auto GetSize() const -> uint64_t { return Size; }
+  // Copies lines [first, first + count) into out, replacing its contents.
+  auto CopyLines(size_t first, size_t count, std::string &out) const
+      -> size_t {
+    out.clear();
+    size_t const lines = LineCount();
+    if (first >= lines) {
+      return 0;
+    }
+    count = (count < lines - first) ? count : lines - first;
+    uint64_t const begin = LineStart(first);
+    uint64_t const end = SkipLines(begin, count);
+    out.reserve(static_cast<size_t>(end - begin));
+    for (uint64_t at = begin; at < end;) {
+      size_t const index = static_cast<size_t>(at / ChunkSize);
+      size_t const offset = static_cast<size_t>(at % ChunkSize);
+      size_t const n = static_cast<size_t>(
+          (end - at < ChunkSize - offset) ? end - at : ChunkSize - offset);
+      out.append(ChunkAt(index) + offset, n);
+      at += n;
+    }
+    return count;
+  }
+  // Sets how much output is kept on the heap before older chunks are spilled.
+  auto SetRamLimit(size_t ram) -> void {
+    RamLimit = ram;
+    Spill();
+  }
+  auto GetRamLimit() const -> size_t { return RamLimit; }
+  // Drops all output and releases the heap chunks and the spill file.
+  auto Clear() -> void {
+    for (char *chunk : Chunks) {
+      free(chunk);
+    }
+    Chunks.clear();
+    Marks.assign(1, 0);
+    NewLines = 0;
+    LastLine = 0;
+    Size = 0;
+    Resident = 0;
+    Spilled = 0;
+    if (Map != nullptr) {
+      munmap(Map, MapLimit);
+      Map = nullptr;
+    }
+    if (File != -1) {
+      close(File);
+      File = -1;
+    }
+    Failed = false;
+  }
+};
+} // namespace Origin
+#endif // SCROLLBACK_HPP
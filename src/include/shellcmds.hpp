@@ -0,0 +1,73 @@
+#ifndef SHELLCMDS_HPP
+#define SHELLCMDS_HPP
+#include "builtin.hpp"
+#include "env.hpp"
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+namespace Origin {
+/* The built-ins the interactive shell and the batch runner both bind. Each
+takes its expanded arguments and a writer for what it prints to stdout (1) and
+stderr (2), and returns an exit status. Variables are read and changed in the
+shell's environment. */
+struct ShellCommands {
+  // Runs 'cd [dir]', changing to $HOME when no directory is given. Spawned
+  // commands inherit the new directory.
+  static auto ChangeDir(const Builtins::Args &args,
+                        const Builtins::Writer &print) -> int {
+    const char *home = Environment::Shell().Get("HOME");
+    std::string const dir =
+        (args.size() > 1) ? args[1] : (home != nullptr ? home : "/");
+    if (chdir(dir.c_str()) != 0) {
+      print(2, "cd: " + dir + ": " + strerror(errno) + "\n");
+      return 1;
+    }
+    return 0;
+  }
+  // Runs 'export [name[=value]]...', listing the exported variables when no
+  // names are given. A name without a value exports the shell variable.
+  static auto Export(const Builtins::Args &args,
+                     const Builtins::Writer &print) -> int {
+    Environment &env = Environment::Shell();
+    if (args.size() == 1) {
+      std::string out;
+      for (auto const &var : env.List()) {
+        out += "export " + var + "\n";
+      }
+      print(1, out);
+      return 0;
+    }
+    int status = 0;
+    for (size_t i = 1; i < args.size(); i++) {
+      size_t const eq = args[i].find('=');
+      std::string const name = args[i].substr(0, eq);
+      if (!Environment::IsName(name)) {
+        print(2, "export: " + args[i] + ": not a valid name\n");
+        status = 1;
+      } else if (eq != std::string::npos) {
+        env.Export(name, std::string_view(args[i]).substr(eq + 1));
+      } else {
+        env.Export(name);
+      }
+    }
+    return status;
+  }
+  // Runs 'unset name...', removing variables from the environment.
+  static auto Unset(const Builtins::Args &args,
+                    const Builtins::Writer &print) -> int {
+    int status = 0;
+    for (size_t i = 1; i < args.size(); i++) {
+      if (!Environment::IsName(args[i])) {
+        print(2, "unset: " + args[i] + ": not a valid name\n");
+        status = 1;
+      } else {
+        Environment::Shell().Unset(args[i]);
+      }
+    }
+    return status;
+  }
+};
+} // namespace Origin
+#endif // SHELLCMDS_HPP
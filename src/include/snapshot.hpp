@@ -0,0 +1,71 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+#include "cell.hpp"
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+namespace Origin {
+using namespace std::chrono;
+/* Everything the renderer needs to draw one frame, copied out of App by the
+main thread. Once published a snapshot is never modified, so the renderer can
+read it without taking a lock. */
+struct Snapshot {
+  /* The prompt, which the input follows in brackets. */
+  std::string Prompt{};
+  std::string Input{};
+  /* Byte offset of the cursor in Input. */
+  size_t Cursor{0};
+  /* Scrollback lines shown above the terminal's rows when scrolled back. */
+  std::string Exec{};
+  /* Rows of the terminal, CellCols cells each. */
+  std::vector<Cell> Cells{};
+  int CellCols{0};
+  /* One line per background job, shown above the output. */
+  std::string Jobs{};
+  int State{0};
+  long Cycles{0};
+  /* The run timer at the moment of publishing. While Ticking is set the
+  renderer advances it by the time passed since 'Since', so the clock keeps
+  moving between publishes. */
+  nanoseconds Elapsed{nanoseconds::zero()};
+  nanoseconds Since{nanoseconds::zero()};
+  bool Ticking{false};
+};
+/* Hands values from one writer thread to one reader thread without locks. Of
+the three slots, the writer owns one, the reader owns one and the third holds
+the latest published value; Publish() and Read() each swap their slot with the
+middle one in a single atomic exchange. The writer never waits for the reader,
+and the reader always sees a complete value, skipping any that were replaced
+before it looked. Slots are reused, so strings inside them keep their capacity
+and steady-state publishing does not allocate. */
+template <typename T> struct Publisher {
+private:
+  static constexpr int Fresh = 4;
+  T Slots[3];
+  std::atomic<int> Middle{1};
+  int Back{0};
+  int Front{2};
+
+public:
+  // Returns the writer's slot. It holds an older value and must be filled in
+  // completely before publishing.
+  auto GetBack() -> T & { return Slots[Back]; }
+  // Makes the writer's slot the latest value.
+  auto Publish() -> void {
+    Back = Middle.exchange(Back | Fresh, std::memory_order_acq_rel) & 3;
+  }
+  // Takes the latest value if one was published since the last call.
+  // Returns false if there was nothing new.
+  auto Read() -> bool {
+    if ((Middle.load(std::memory_order_relaxed) & Fresh) == 0) {
+      return false;
+    }
+    Front = Middle.exchange(Front, std::memory_order_acq_rel) & 3;
+    return true;
+  }
+  // Returns the reader's slot, the value taken by the last Read().
+  auto GetFront() const -> const T & { return Slots[Front]; }
+};
+} // namespace Origin
+#endif // SNAPSHOT_HPP
@@ -0,0 +1,901 @@
+#ifndef TERMINAL_HPP
+#define TERMINAL_HPP
+#include "cell.hpp"
+#include "scrollback.hpp"
+#include "utf8.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+namespace Origin {
+/* A VT/ANSI terminal that command output is written into. Bytes are run
+through a table-driven state machine after the DEC/ANSI parser model: each byte
+is mapped to a class, and one table lookup on state and class gives the action
+to take and the next state. In the ground state runs of printable ASCII are
+found sixteen at a time with SSE2 and copied into the grid in one loop, so the
+state machine only runs at escape and control bytes, and only bytes from 0x80
+up go through the UTF-8 decoder and the width table. Wide characters take two
+cells and combining marks ride on the cell before them. The grid keeps rows
+behind an index, so scrolling rotates row numbers instead of moving cells. Rows
+that scroll off the top of the main screen are appended to the scrollback as
+plain text, one line per row; the alternate screen used by full-screen programs
+never reaches it. A line feed also returns the carriage, so text from the shell
+itself, which ends lines with a bare '\n', lines up with output that passed
+through a pty. */
+struct Terminal {
+private:
+  /* Parser states. Osc covers every string command, which are all ignored. */
+  static constexpr uint8_t Ground = 0, Escape = 1, EscInter = 2,
+                           CsiEntry = 3, CsiParam = 4, CsiInter = 5,
+                           CsiIgnore = 6, Osc = 7, StateCount = 8;
+  /* Byte classes. */
+  static constexpr uint8_t Ctl = 0, Cancel = 1, Esc = 2, Inter = 3,
+                           Digit = 4, Sep = 5, Marker = 6, Final = 7,
+                           CsiIntro = 8, OscIntro = 9, StrIntro = 10,
+                           Del = 11, High = 12, Bel = 13, ClassCount = 14;
+  /* Actions, kept in the high nibble of a transition. */
+  static constexpr uint8_t None = 0, Print = 1, Execute = 2, Clear = 3,
+                           Collect = 4, Param = 5, EscDispatch = 6,
+                           CsiDispatch = 7;
+  struct Tables {
+    uint8_t Class[256];
+    uint8_t Next[StateCount][ClassCount];
+  };
+  static constexpr auto Move(uint8_t action, uint8_t state) -> uint8_t {
+    return static_cast<uint8_t>(action << 4 | state);
+  }
+  static constexpr auto Build() -> Tables {
+    Tables t{};
+    for (int c = 0; c < 256; c++) {
+      uint8_t k = Final;
+      if (c == 0x07) {
+        k = Bel;
+      } else if (c == 0x18 || c == 0x1a) {
+        k = Cancel;
+      } else if (c == 0x1b) {
+        k = Esc;
+      } else if (c < 0x20) {
+        k = Ctl;
+      } else if (c < 0x30) {
+        k = Inter;
+      } else if (c < 0x3a) {
+        k = Digit;
+      } else if (c < 0x3c) {
+        k = Sep;
+      } else if (c < 0x40) {
+        k = Marker;
+      } else if (c == '[') {
+        k = CsiIntro;
+      } else if (c == ']') {
+        k = OscIntro;
+      } else if (c == 'P' || c == 'X' || c == '^' || c == '_') {
+        k = StrIntro;
+      } else if (c == 0x7f) {
+        k = Del;
+      } else if (c >= 0x80) {
+        k = High;
+      }
+      t.Class[c] = k;
+    }
+    for (uint8_t s = 0; s < StateCount; s++) {
+      for (uint8_t k = 0; k < ClassCount; k++) {
+        bool const ctl = (k == Ctl || k == Bel);
+        bool const final = (k == Final || k == CsiIntro || k == OscIntro ||
+                            k == StrIntro);
+        uint8_t next = Move(None, s);
+        if (k == Cancel) {
+          next = Move(None, Ground);
+        } else if (k == Esc) {
+          next = Move(Clear, Escape);
+        } else if (s == Osc) {
+          next = Move(None, (k == Bel) ? Ground : Osc);
+        } else if (ctl) {
+          next = Move(Execute, s);
+        } else if (k == Del) {
+          next = Move(None, s);
+        } else if (s == Ground) {
+          next = Move(Print, Ground);
+        } else if (k == High) {
+          next = Move(None, s);
+        } else if (s == Escape) {
+          next = (k == Inter)      ? Move(Collect, EscInter)
+                 : (k == CsiIntro) ? Move(Clear, CsiEntry)
+                 : (k == OscIntro || k == StrIntro)
+                     ? Move(None, Osc)
+                     : Move(EscDispatch, Ground);
+        } else if (s == EscInter) {
+          next = (k == Inter) ? Move(Collect, EscInter)
+                              : Move(EscDispatch, Ground);
+        } else if (s == CsiIgnore) {
+          next = final ? Move(None, Ground) : Move(None, CsiIgnore);
+        } else if (final) {
+          next = Move(CsiDispatch, Ground);
+        } else if (k == Inter) {
+          next = Move(Collect, CsiInter);
+        } else if (s == CsiInter) {
+          next = Move(None, CsiIgnore);
+        } else if (k == Marker) {
+          next = (s == CsiEntry) ? Move(Collect, CsiParam)
+                                 : Move(None, CsiIgnore);
+        } else {
+          next = Move(Param, CsiParam);
+        }
+        t.Next[s][k] = next;
+      }
+    }
+    return t;
+  }
+  static const Tables Table;
+  static const int MaxParams = 16;
+  static const int TabWidth = 8;
+
+  int Width{0};
+  int Height{0};
+  /* Cells of every row, and for each row on screen the row holding it. */
+  std::vector<Cell> Cells;
+  std::vector<int> Rows;
+  /* For each row, a bound past which every cell is a default blank, so
+  blanking and saving rows only touch what was written. */
+  std::vector<int> Ends;
+  /* The main screen's cells, rows, bounds and cursor while the alternate one
+  is shown. */
+  bool Alt{false};
+  std::vector<Cell> MainCells;
+  std::vector<int> MainRows;
+  std::vector<int> MainEnds;
+  int MainX{0};
+  int MainY{0};
+  int X{0};
+  int Y{0};
+  /* Set after a character lands in the last column; the next one wraps. */
+  bool WrapNext{false};
+  bool AutoWrap{true};
+  /* The scrolling region, first and last row. */
+  int Top{0};
+  int Bottom{0};
+  /* The style new characters are written with, and the last one written. */
+  Cell Pen;
+  uint32_t Last{' '};
+  int SavedX{0};
+  int SavedY{0};
+  Cell SavedPen;
+  uint8_t State{Ground};
+  int Params[MaxParams]{};
+  int ParamCount{0};
+  char Private{0};
+  char Intermediate{0};
+  Scrollback *Log{nullptr};
+  /* Rows saved during the current Append(), given to the scrollback in one
+  piece at its end. */
+  std::string Saved;
+  Utf8 Decoder;
+
+  auto RowAt(int y) -> Cell * {
+    return &Cells[static_cast<size_t>(Rows[y]) * Width];
+  }
+  // Returns a blank cell in the current background colour.
+  auto Blank() const -> Cell {
+    Cell blank;
+    blank.Bg = Pen.Bg;
+    return blank;
+  }
+  // Raises the bound of row y to cover cells before 'to'.
+  auto Extend(int y, int to) -> void {
+    int &end = Ends[static_cast<size_t>(Rows[y])];
+    end = std::max(end, to);
+  }
+  // Blanks cells [from, to) of row y. Default blanks past the row's bound are
+  // already there and are skipped.
+  auto Fill(int y, int from, int to) -> void {
+    Cell *row = RowAt(y);
+    Cell const blank = Blank();
+    int &end = Ends[static_cast<size_t>(Rows[y])];
+    from = std::max(from, 0);
+    to = std::min(to, Width);
+    if (blank.Bg != Cell::DefaultColor) {
+      end = std::max(end, to);
+    } else if (to >= end) {
+      to = end;
+      end = std::min(end, from);
+    }
+    if (from < to) {
+      std::fill(row + from, row + to, blank);
+    }
+  }
+  // Queues a row for the scrollback without its trailing blanks.
+  auto Save(int y) -> void {
+    if (Log == nullptr || Alt) {
+      return;
+    }
+    const Cell *row = RowAt(y);
+    int end = Ends[static_cast<size_t>(Rows[y])];
+    while (end > 0 && row[end - 1].Code == ' ') {
+      end--;
+    }
+    size_t const base = Saved.size();
+    Saved.resize(base + static_cast<size_t>(end));
+    int x = 0;
+    for (; x < end && row[x].Code < 0x80 && row[x].Flags <= Cell::StyleMask;
+         x++) {
+      Saved[base + static_cast<size_t>(x)] = static_cast<char>(row[x].Code);
+    }
+    Saved.resize(base + static_cast<size_t>(x));
+    for (; x < end; x++) {
+      if (row[x].Code != Cell::WideTail) {
+        Utf8::Encode(row[x].Code, Saved);
+      }
+      if (row[x].GetMark() != 0) {
+        Utf8::Encode(row[x].GetMark(), Saved);
+      }
+    }
+    Saved += '\n';
+  }
+  // Hands the queued rows to the scrollback.
+  auto Commit() -> void {
+    if (!Saved.empty()) {
+      Log->Append(Saved);
+      Saved.clear();
+    }
+  }
+  // Scrolls rows [top, bottom] up by n, blanking the rows that come in at
+  // the bottom. Rows leaving the top of the screen go to the scrollback when
+  // 'save' is set.
+  auto ScrollUp(int top, int bottom, int n, bool save) -> void {
+    n = std::min(n, bottom - top + 1);
+    for (int i = 0; i < n; i++) {
+      if (save && top == 0) {
+        Save(top);
+      }
+      int const row = Rows[top];
+      std::copy(Rows.begin() + top + 1, Rows.begin() + bottom + 1,
+                Rows.begin() + top);
+      Rows[bottom] = row;
+      Fill(bottom, 0, Width);
+    }
+  }
+  auto ScrollDown(int top, int bottom, int n) -> void {
+    n = std::min(n, bottom - top + 1);
+    for (int i = 0; i < n; i++) {
+      int const row = Rows[bottom];
+      std::copy_backward(Rows.begin() + top, Rows.begin() + bottom,
+                         Rows.begin() + bottom + 1);
+      Rows[top] = row;
+      Fill(top, 0, Width);
+    }
+  }
+  auto LineFeed() -> void {
+    WrapNext = false;
+    if (Y == Bottom) {
+      ScrollUp(Top, Bottom, 1, true);
+    } else if (Y < Height - 1) {
+      Y++;
+    }
+  }
+  // Blanks the other half of any wide character that writing cells
+  // [from, to) of 'row' would cut in two.
+  auto Split(Cell *row, int from, int to) -> void {
+    if (from > 0 && row[from].Code == Cell::WideTail) {
+      row[from - 1].Code = ' ';
+    }
+    if (to < Width && row[to].Code == Cell::WideTail) {
+      row[to].Code = ' ';
+    }
+  }
+  // Writes a run of printable ASCII at the cursor, wrapping at the right
+  // edge.
+  auto Put(const char *src, size_t len) -> void {
+    Cell cell = Pen;
+    while (len > 0) {
+      if (WrapNext) {
+        if (!AutoWrap) {
+          // Without wrapping the last column is overwritten in place.
+          cell.Code = static_cast<unsigned char>(src[len - 1]);
+          Split(RowAt(Y), Width - 1, Width);
+          RowAt(Y)[Width - 1] = cell;
+          Extend(Y, Width);
+          break;
+        }
+        X = 0;
+        LineFeed();
+      }
+      size_t const n = std::min(len, static_cast<size_t>(Width - X));
+      Split(RowAt(Y), X, X + static_cast<int>(n));
+      Cell *row = RowAt(Y) + X;
+      for (size_t i = 0; i < n; i++) {
+        cell.Code = static_cast<unsigned char>(src[i]);
+        row[i] = cell;
+      }
+      Extend(Y, X + static_cast<int>(n));
+      src += n;
+      len -= n;
+      X += static_cast<int>(n);
+      if (X >= Width) {
+        X = Width - 1;
+        WrapNext = true;
+      }
+      Last = cell.Code;
+    }
+  }
+  // Writes one decoded code point at the cursor. A wide character that does
+  // not fit before the right edge moves to the next line whole; a combining
+  // mark goes on the character before the cursor.
+  auto PutCode(uint32_t code) -> void {
+    if (code >= 0x80 && code < 0xa0) {
+      return;
+    }
+    int const width = Utf8::Width(code);
+    if (width == 0) {
+      int const x = WrapNext ? X : X - 1;
+      if (x >= 0) {
+        Cell *cell = RowAt(Y) + x;
+        cell -= (cell->Code == Cell::WideTail && x > 0) ? 1 : 0;
+        cell->SetMark(code);
+      }
+      return;
+    }
+    if (width > Width) {
+      return;
+    }
+    if (WrapNext || X + width > Width) {
+      if (AutoWrap) {
+        if (!WrapNext) {
+          Fill(Y, X, Width);
+        }
+        X = 0;
+        LineFeed();
+      } else {
+        X = Width - width;
+      }
+    }
+    Cell *row = RowAt(Y);
+    Split(row, X, X + width);
+    Cell cell = Pen;
+    cell.Code = code;
+    row[X] = cell;
+    if (width == 2) {
+      cell.Code = Cell::WideTail;
+      row[X + 1] = cell;
+    }
+    Extend(Y, X + width);
+    Last = code;
+    X += width;
+    WrapNext = false;
+    if (X >= Width) {
+      X = Width - 1;
+      WrapNext = true;
+    }
+  }
+  // Returns the length of the run of bytes from 0x80 up at the start of
+  // 'src'.
+  static auto Encoded(const char *src, size_t len) -> size_t {
+    size_t i = 0;
+    while (i < len && static_cast<unsigned char>(src[i]) >= 0x80) {
+      i++;
+    }
+    return i;
+  }
+  // Returns the length of the run of printable ASCII at the start of 'src'.
+  static auto Printable(const char *src, size_t len) -> size_t {
+    size_t i = 0;
+#if defined(__SSE2__)
+    __m128i const space = _mm_set1_epi8(0x20);
+    __m128i const del = _mm_set1_epi8(0x7f);
+    for (; i + 16 <= len; i += 16) {
+      __m128i const v =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+      // Signed compare: bytes from 0x80 up are negative, so they stop the
+      // run along with the controls.
+      int const mask = _mm_movemask_epi8(
+          _mm_or_si128(_mm_cmplt_epi8(v, space), _mm_cmpeq_epi8(v, del)));
+      if (mask != 0) {
+        return i + static_cast<size_t>(__builtin_ctz(mask));
+      }
+    }
+#endif
+    for (; i < len; i++) {
+      unsigned char const c = static_cast<unsigned char>(src[i]);
+      if (c < 0x20 || c >= 0x7f) {
+        break;
+      }
+    }
+    return i;
+  }
+  auto Control(unsigned char c) -> void {
+    switch (c) {
+    case '\b':
+      X = (X > 0) ? X - 1 : 0;
+      WrapNext = false;
+      break;
+    case '\t':
+      X = std::min((X / TabWidth + 1) * TabWidth, Width - 1);
+      break;
+    case '\n':
+    case '\v':
+    case '\f':
+      LineFeed();
+      X = 0;
+      break;
+    case '\r':
+      X = 0;
+      WrapNext = false;
+      break;
+    default:
+      break;
+    }
+  }
+  auto Arg(int i, int fallback) const -> int {
+    return (i < ParamCount && Params[i] > 0) ? Params[i] : fallback;
+  }
+  auto Goto(int x, int y) -> void {
+    X = std::clamp(x, 0, Width - 1);
+    Y = std::clamp(y, 0, Height - 1);
+    WrapNext = false;
+  }
+  // Exchanges the main screen's cells, rows, bounds and cursor with those in
+  // use.
+  auto SwapMain() -> void {
+    Cells.swap(MainCells);
+    Rows.swap(MainRows);
+    Ends.swap(MainEnds);
+    std::swap(X, MainX);
+    std::swap(Y, MainY);
+  }
+  // Copies the grid in use into one of the new size, which Width and Height
+  // do not give yet, keeping the rows down to the cursor. Rows pushed off the
+  // top go to the scrollback from the main screen only.
+  auto Fit(int width, int height) -> void {
+    int const drop = std::max(0, Y + 1 - height);
+    for (int y = 0; y < drop; y++) {
+      Save(y);
+    }
+    std::vector<Cell> cells(static_cast<size_t>(width) * height);
+    std::vector<int> ends(static_cast<size_t>(height), 0);
+    for (int y = 0; y < height && y + drop < Height; y++) {
+      const Cell *row = RowAt(y + drop);
+      std::copy(row, row + std::min(width, Width),
+                cells.begin() + static_cast<long>(y) * width);
+      ends[y] = std::min(width, Ends[static_cast<size_t>(Rows[y + drop])]);
+    }
+    Cells.swap(cells);
+    Ends.swap(ends);
+    Rows.resize(static_cast<size_t>(height));
+    for (int y = 0; y < height; y++) {
+      Rows[y] = y;
+    }
+    X = std::clamp(X, 0, width - 1);
+    Y = std::clamp(Y - drop, 0, height - 1);
+  }
+  // Switches to or from the alternate screen, which starts out blank.
+  auto Alternate(bool on) -> void {
+    if (on == Alt) {
+      return;
+    }
+    Alt = on;
+    if (on) {
+      MainCells.swap(Cells);
+      MainRows.swap(Rows);
+      MainEnds.swap(Ends);
+      MainX = X;
+      MainY = Y;
+      Cells.assign(MainCells.size(), Cell{});
+      Rows = MainRows;
+      Ends.assign(MainEnds.size(), 0);
+    } else {
+      Cells.swap(MainCells);
+      Rows.swap(MainRows);
+      Ends.swap(MainEnds);
+      Goto(MainX, MainY);
+    }
+  }
+  auto Mode(bool on) -> void {
+    for (int i = 0; i < ParamCount; i++) {
+      if (Params[i] == 7) {
+        AutoWrap = on;
+      } else if (Params[i] == 47 || Params[i] == 1047) {
+        Alternate(on);
+      } else if (Params[i] == 1049) {
+        if (on) {
+          SaveCursor();
+        }
+        Alternate(on);
+        if (!on) {
+          RestoreCursor();
+        }
+      }
+    }
+  }
+  auto SaveCursor() -> void {
+    SavedX = X;
+    SavedY = Y;
+    SavedPen = Pen;
+  }
+  auto RestoreCursor() -> void {
+    Goto(SavedX, SavedY);
+    Pen = SavedPen;
+  }
+  // Reads the colour of an extended colour parameter, '5;n' or '2;r;g;b',
+  // starting at 'i', and returns the index of its last parameter.
+  auto ExtendedColor(int i, uint32_t &color) const -> int {
+    if (Arg(i + 1, 0) == 5 && i + 2 < ParamCount) {
+      color = static_cast<uint32_t>(Params[i + 2] & 0xff);
+      return i + 2;
+    }
+    if (Arg(i + 1, 0) == 2 && i + 4 < ParamCount) {
+      color = Cell::TrueColor |
+              static_cast<uint32_t>((Params[i + 2] & 0xff) << 16 |
+                                    (Params[i + 3] & 0xff) << 8 |
+                                    (Params[i + 4] & 0xff));
+      return i + 4;
+    }
+    return ParamCount;
+  }
+  auto Style() -> void {
+    if (ParamCount == 0) {
+      Pen = Cell{};
+      return;
+    }
+    static const uint32_t set[10] = {0,           Cell::Bold,   Cell::Faint,
+                                     Cell::Italic, Cell::Underline,
+                                     Cell::Blink, Cell::Blink,  Cell::Inverse,
+                                     Cell::Hidden, Cell::Strike};
+    for (int i = 0; i < ParamCount; i++) {
+      int const p = Params[i];
+      if (p == 0) {
+        Pen = Cell{};
+      } else if (p < 10) {
+        Pen.Flags |= set[p];
+      } else if (p == 21) {
+        Pen.Flags |= Cell::Underline;
+      } else if (p == 22) {
+        Pen.Flags &= ~(Cell::Bold | Cell::Faint);
+      } else if (p >= 23 && p <= 29 && p != 26) {
+        Pen.Flags &= ~set[p - 20];
+      } else if (p >= 30 && p <= 37) {
+        Pen.Fg = static_cast<uint32_t>(p - 30);
+      } else if (p == 38) {
+        i = ExtendedColor(i, Pen.Fg);
+      } else if (p == 39) {
+        Pen.Fg = Cell::DefaultColor;
+      } else if (p >= 40 && p <= 47) {
+        Pen.Bg = static_cast<uint32_t>(p - 40);
+      } else if (p == 48) {
+        i = ExtendedColor(i, Pen.Bg);
+      } else if (p == 49) {
+        Pen.Bg = Cell::DefaultColor;
+      } else if (p >= 90 && p <= 97) {
+        Pen.Fg = static_cast<uint32_t>(p - 90 + 8);
+      } else if (p >= 100 && p <= 107) {
+        Pen.Bg = static_cast<uint32_t>(p - 100 + 8);
+      }
+    }
+  }
+  auto Erase(int mode, bool line) -> void {
+    if (mode == 3 && !line) {
+      if (Log != nullptr && !Alt) {
+        Saved.clear();
+        Log->Clear();
+      }
+      return;
+    }
+    int const from = (mode == 0) ? X : 0;
+    int const to = (mode == 1) ? X + 1 : Width;
+    Fill(Y, from, to);
+    if (line) {
+      return;
+    }
+    for (int y = (mode == 0) ? Y + 1 : 0; y < ((mode == 0) ? Height : Y);
+         y++) {
+      Fill(y, 0, Width);
+    }
+    if (mode == 2) {
+      for (int y = Y; y < Height; y++) {
+        Fill(y, 0, Width);
+      }
+    }
+  }
+  // Shifts the cells right of the cursor by n, right when 'insert' is set
+  // and left otherwise, blanking the cells left behind.
+  auto Shift(int n, bool insert) -> void {
+    Cell *row = RowAt(Y);
+    n = std::min(n, Width - X);
+    Extend(Y, Width);
+    if (insert) {
+      std::copy_backward(row + X, row + Width - n, row + Width);
+      std::fill(row + X, row + X + n, Blank());
+    } else {
+      std::copy(row + X + n, row + Width, row + X);
+      std::fill(row + Width - n, row + Width, Blank());
+    }
+  }
+  auto DispatchCsi(char c) -> void {
+    int const n = Arg(0, 1);
+    if (Private == '?') {
+      if (c == 'h' || c == 'l') {
+        Mode(c == 'h');
+      }
+      return;
+    }
+    if (Private != 0 || Intermediate != 0) {
+      return;
+    }
+    switch (c) {
+    case '@':
+      Shift(n, true);
+      break;
+    case 'A':
+      Goto(X, std::max(Y - n, (Y >= Top) ? Top : 0));
+      break;
+    case 'B':
+    case 'e':
+      Goto(X, std::min(Y + n, (Y <= Bottom) ? Bottom : Height - 1));
+      break;
+    case 'C':
+    case 'a':
+      Goto(X + n, Y);
+      break;
+    case 'D':
+      Goto(X - n, Y);
+      break;
+    case 'E':
+      Goto(0, std::min(Y + n, (Y <= Bottom) ? Bottom : Height - 1));
+      break;
+    case 'F':
+      Goto(0, std::max(Y - n, (Y >= Top) ? Top : 0));
+      break;
+    case 'G':
+    case '`':
+      Goto(n - 1, Y);
+      break;
+    case 'H':
+    case 'f':
+      Goto(Arg(1, 1) - 1, n - 1);
+      break;
+    case 'd':
+      Goto(X, n - 1);
+      break;
+    case 'J':
+      Erase(Arg(0, 0), false);
+      break;
+    case 'K':
+      Erase(Arg(0, 0), true);
+      break;
+    case 'L':
+      if (Y >= Top && Y <= Bottom) {
+        ScrollDown(Y, Bottom, n);
+      }
+      break;
+    case 'M':
+      if (Y >= Top && Y <= Bottom) {
+        ScrollUp(Y, Bottom, n, false);
+      }
+      break;
+    case 'P':
+      Shift(n, false);
+      break;
+    case 'X':
+      Fill(Y, X, X + n);
+      break;
+    case 'S':
+      ScrollUp(Top, Bottom, n, false);
+      break;
+    case 'T':
+      ScrollDown(Top, Bottom, n);
+      break;
+    case 'b':
+      for (int i = 0; i < n && i < Width * Height; i++) {
+        PutCode(Last);
+      }
+      break;
+    case 'm':
+      Style();
+      break;
+    case 'r':
+      Top = Arg(0, 1) - 1;
+      Bottom = Arg(1, Height) - 1;
+      if (Top >= Bottom || Bottom >= Height) {
+        Top = 0;
+        Bottom = Height - 1;
+      }
+      Goto(0, 0);
+      break;
+    case 's':
+      SaveCursor();
+      break;
+    case 'u':
+      RestoreCursor();
+      break;
+    default:
+      break;
+    }
+  }
+  auto DispatchEsc(char c) -> void {
+    if (Intermediate != 0) {
+      return;
+    }
+    switch (c) {
+    case '7':
+      SaveCursor();
+      break;
+    case '8':
+      RestoreCursor();
+      break;
+    case 'D':
+      LineFeed();
+      break;
+    case 'E':
+      LineFeed();
+      X = 0;
+      break;
+    case 'M':
+      WrapNext = false;
+      if (Y == Top) {
+        ScrollDown(Top, Bottom, 1);
+      } else if (Y > 0) {
+        Y--;
+      }
+      break;
+    case 'c':
+      Reset();
+      break;
+    default:
+      break;
+    }
+  }
+  auto Act(uint8_t action, unsigned char c) -> void {
+    switch (action) {
+    case Print: {
+      char const byte = static_cast<char>(c);
+      Put(&byte, 1);
+      break;
+    }
+    case Execute:
+      Control(c);
+      break;
+    case Clear:
+      ParamCount = 0;
+      Private = 0;
+      Intermediate = 0;
+      break;
+    case Collect:
+      if (c >= 0x3c && c <= 0x3f) {
+        Private = static_cast<char>(c);
+      } else {
+        Intermediate = static_cast<char>(c);
+      }
+      break;
+    case Param:
+      if (ParamCount == 0) {
+        Params[ParamCount++] = 0;
+      }
+      if (c == ';' || c == ':') {
+        if (ParamCount < MaxParams) {
+          Params[ParamCount++] = 0;
+        }
+      } else {
+        int &p = Params[ParamCount - 1];
+        p = std::min(p * 10 + (c - '0'), 65535);
+      }
+      break;
+    case EscDispatch:
+      DispatchEsc(static_cast<char>(c));
+      break;
+    case CsiDispatch:
+      DispatchCsi(static_cast<char>(c));
+      break;
+    default:
+      break;
+    }
+  }
+  auto Reset() -> void {
+    Alternate(false);
+    Pen = Cell{};
+    SavedPen = Cell{};
+    AutoWrap = true;
+    Top = 0;
+    Bottom = Height - 1;
+    for (int y = 0; y < Height; y++) {
+      Fill(y, 0, Width);
+    }
+    Goto(0, 0);
+  }
+
+public:
+  Terminal(int width = 80, int height = 20) { Resize(width, height); }
+  Terminal(const Terminal &) = delete;
+  auto operator=(const Terminal &) -> Terminal & = delete;
+  // Writes output into the terminal. Rows scrolled off reach the scrollback
+  // together when it returns.
+  auto Append(const char *src, size_t len) -> void {
+    size_t i = 0;
+    while (i < len) {
+      if (State == Ground) {
+        if (static_cast<unsigned char>(src[i]) >= 0x80) {
+          size_t const run = Encoded(src + i, len - i);
+          Decoder.Decode(src + i, run, [this](uint32_t c) { PutCode(c); });
+          i += run;
+          continue;
+        }
+        if (Decoder.Reset()) {
+          PutCode(Utf8::Replacement);
+        }
+        size_t const run = Printable(src + i, len - i);
+        if (run > 0) {
+          Put(src + i, run);
+          i += run;
+          continue;
+        }
+      }
+      unsigned char const c = static_cast<unsigned char>(src[i++]);
+      uint8_t const move = Table.Next[State][Table.Class[c]];
+      State = move & 15;
+      Act(move >> 4, c);
+    }
+    Commit();
+  }
+  auto Append(const std::string &text) -> void {
+    Append(text.data(), text.size());
+  }
+  // Resizes the grid. Rows that no longer fit above the cursor go to the
+  // scrollback, and the scrolling region is reset. On the alternate screen
+  // the main one is resized too, with its own cursor, so the program using
+  // the alternate screen stays on it and finds the shell's output intact
+  // when it leaves.
+  auto Resize(int width, int height) -> bool {
+    width = std::max(width, 1);
+    height = std::max(height, 1);
+    if (width == Width && height == Height) {
+      return false;
+    }
+    if (Alt) {
+      SwapMain();
+      Alt = false;
+      Fit(width, height);
+      Alt = true;
+      SwapMain();
+    }
+    Fit(width, height);
+    Width = width;
+    Height = height;
+    Top = 0;
+    Bottom = height - 1;
+    WrapNext = false;
+    Commit();
+    return true;
+  }
+  // Returns the number of rows down to the last one holding anything or the
+  // cursor, whichever is lower.
+  auto Used() -> int {
+    Cell const blank;
+    for (int y = Height - 1; y > Y; y--) {
+      const Cell *row = RowAt(y);
+      if (std::any_of(row, row + Ends[static_cast<size_t>(Rows[y])],
+                      [&blank](const Cell &c) { return c != blank; })) {
+        return y + 1;
+      }
+    }
+    return Y + 1;
+  }
+  // Copies rows [first, first + count) into 'out', replacing its contents.
+  auto CopyRows(int first, int count, std::vector<Cell> &out) -> void {
+    out.clear();
+    for (int y = std::max(first, 0); y < first + count && y < Height; y++) {
+      const Cell *row = RowAt(y);
+      out.insert(out.end(), row, row + Width);
+    }
+  }
+  // Returns true if the cursor is at the start of a line.
+  auto AtLineStart() const -> bool { return X == 0 && !WrapNext; }
+  auto GetWidth() const -> int { return Width; }
+  auto GetHeight() const -> int { return Height; }
+  // Sets the scrollback that receives rows scrolled off the top.
+  auto SetScrollback(Scrollback *log) -> void { Log = log; }
+};
+/* Built at compile time; defined here since the class must be complete. */
+inline const Terminal::Tables Terminal::Table = Terminal::Build();
+} // namespace Origin
+#endif // TERMINAL_HPP
@@ -0,0 +1,454 @@
+#ifndef UTF8_HPP
+#define UTF8_HPP
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+namespace Origin {
+/* The code points that take no cell or two cells, after Unicode's
+nonspacing and enclosing marks, format characters and East Asian Wide and
+Fullwidth classes. Both lists are sorted; zero width wins where they meet. */
+struct WidthRanges {
+  struct Range {
+    uint32_t First;
+    uint32_t Last;
+  };
+  static constexpr Range Zero[] = {
+      {0x0300, 0x036f},   {0x0483, 0x0489},   {0x0591, 0x05bd},
+      {0x05bf, 0x05bf},   {0x05c1, 0x05c2},   {0x05c4, 0x05c5},
+      {0x05c7, 0x05c7},   {0x0610, 0x061a},   {0x061c, 0x061c},
+      {0x064b, 0x065f},   {0x0670, 0x0670},   {0x06d6, 0x06dc},
+      {0x06df, 0x06e4},   {0x06e7, 0x06e8},   {0x06ea, 0x06ed},
+      {0x0711, 0x0711},   {0x0730, 0x074a},   {0x07a6, 0x07b0},
+      {0x07eb, 0x07f3},   {0x07fd, 0x07fd},   {0x0816, 0x0819},
+      {0x081b, 0x0823},   {0x0825, 0x0827},   {0x0829, 0x082d},
+      {0x0859, 0x085b},   {0x0898, 0x089f},   {0x08ca, 0x08e1},
+      {0x08e3, 0x0902},   {0x093a, 0x093a},   {0x093c, 0x093c},
+      {0x0941, 0x0948},   {0x094d, 0x094d},   {0x0951, 0x0957},
+      {0x0962, 0x0963},   {0x0981, 0x0981},   {0x09bc, 0x09bc},
+      {0x09c1, 0x09c4},   {0x09cd, 0x09cd},   {0x09e2, 0x09e3},
+      {0x09fe, 0x09fe},   {0x0a01, 0x0a02},   {0x0a3c, 0x0a3c},
+      {0x0a41, 0x0a42},   {0x0a47, 0x0a48},   {0x0a4b, 0x0a4d},
+      {0x0a51, 0x0a51},   {0x0a70, 0x0a71},   {0x0a75, 0x0a75},
+      {0x0a81, 0x0a82},   {0x0abc, 0x0abc},   {0x0ac1, 0x0ac5},
+      {0x0ac7, 0x0ac8},   {0x0acd, 0x0acd},   {0x0ae2, 0x0ae3},
+      {0x0afa, 0x0aff},   {0x0b01, 0x0b01},   {0x0b3c, 0x0b3c},
+      {0x0b3f, 0x0b3f},   {0x0b41, 0x0b44},   {0x0b4d, 0x0b4d},
+      {0x0b55, 0x0b56},   {0x0b62, 0x0b63},   {0x0b82, 0x0b82},
+      {0x0bc0, 0x0bc0},   {0x0bcd, 0x0bcd},   {0x0c00, 0x0c00},
+      {0x0c04, 0x0c04},   {0x0c3c, 0x0c3c},   {0x0c3e, 0x0c40},
+      {0x0c46, 0x0c48},   {0x0c4a, 0x0c4d},   {0x0c55, 0x0c56},
+      {0x0c62, 0x0c63},   {0x0c81, 0x0c81},   {0x0cbc, 0x0cbc},
+      {0x0cbf, 0x0cbf},   {0x0cc6, 0x0cc6},   {0x0ccc, 0x0ccd},
+      {0x0ce2, 0x0ce3},   {0x0d00, 0x0d01},   {0x0d3b, 0x0d3c},
+      {0x0d41, 0x0d44},   {0x0d4d, 0x0d4d},   {0x0d62, 0x0d63},
+      {0x0d81, 0x0d81},   {0x0dca, 0x0dca},   {0x0dd2, 0x0dd4},
+      {0x0dd6, 0x0dd6},   {0x0e31, 0x0e31},   {0x0e34, 0x0e3a},
+      {0x0e47, 0x0e4e},   {0x0eb1, 0x0eb1},   {0x0eb4, 0x0ebc},
+      {0x0ec8, 0x0ece},   {0x0f18, 0x0f19},   {0x0f35, 0x0f35},
+      {0x0f37, 0x0f37},   {0x0f39, 0x0f39},   {0x0f71, 0x0f7e},
+      {0x0f80, 0x0f84},   {0x0f86, 0x0f87},   {0x0f8d, 0x0f97},
+      {0x0f99, 0x0fbc},   {0x0fc6, 0x0fc6},   {0x102d, 0x1030},
+      {0x1032, 0x1037},   {0x1039, 0x103a},   {0x103d, 0x103e},
+      {0x1058, 0x1059},   {0x105e, 0x1060},   {0x1071, 0x1074},
+      {0x1082, 0x1082},   {0x1085, 0x1086},   {0x108d, 0x108d},
+      {0x109d, 0x109d},   {0x1160, 0x11ff},   {0x135d, 0x135f},
+      {0x1712, 0x1714},   {0x1732, 0x1733},   {0x1752, 0x1753},
+      {0x1772, 0x1773},   {0x17b4, 0x17b5},   {0x17b7, 0x17bd},
+      {0x17c6, 0x17c6},   {0x17c9, 0x17d3},   {0x17dd, 0x17dd},
+      {0x180b, 0x180f},   {0x1885, 0x1886},   {0x18a9, 0x18a9},
+      {0x1920, 0x1922},   {0x1927, 0x1928},   {0x1932, 0x1932},
+      {0x1939, 0x193b},   {0x1a17, 0x1a18},   {0x1a1b, 0x1a1b},
+      {0x1a56, 0x1a56},   {0x1a58, 0x1a5e},   {0x1a60, 0x1a60},
+      {0x1a62, 0x1a62},   {0x1a65, 0x1a6c},   {0x1a73, 0x1a7c},
+      {0x1a7f, 0x1a7f},   {0x1ab0, 0x1ace},   {0x1b00, 0x1b03},
+      {0x1b34, 0x1b34},   {0x1b36, 0x1b3a},   {0x1b3c, 0x1b3c},
+      {0x1b42, 0x1b42},   {0x1b6b, 0x1b73},   {0x1b80, 0x1b81},
+      {0x1ba2, 0x1ba5},   {0x1ba8, 0x1ba9},   {0x1bab, 0x1bad},
+      {0x1be6, 0x1be6},   {0x1be8, 0x1be9},   {0x1bed, 0x1bed},
+      {0x1bef, 0x1bf1},   {0x1c2c, 0x1c33},   {0x1c36, 0x1c37},
+      {0x1cd0, 0x1cd2},   {0x1cd4, 0x1ce0},   {0x1ce2, 0x1ce8},
+      {0x1ced, 0x1ced},   {0x1cf4, 0x1cf4},   {0x1cf8, 0x1cf9},
+      {0x1dc0, 0x1dff},   {0x200b, 0x200f},   {0x202a, 0x202e},
+      {0x2060, 0x2064},   {0x20d0, 0x20f0},   {0x2cef, 0x2cf1},
+      {0x2d7f, 0x2d7f},   {0x2de0, 0x2dff},   {0x302a, 0x302d},
+      {0x3099, 0x309a},   {0xa66f, 0xa672},   {0xa674, 0xa67d},
+      {0xa69e, 0xa69f},   {0xa6f0, 0xa6f1},   {0xa802, 0xa802},
+      {0xa806, 0xa806},   {0xa80b, 0xa80b},   {0xa825, 0xa826},
+      {0xa82c, 0xa82c},   {0xa8c4, 0xa8c5},   {0xa8e0, 0xa8f1},
+      {0xa8ff, 0xa8ff},   {0xa926, 0xa92d},   {0xa947, 0xa951},
+      {0xa980, 0xa982},   {0xa9b3, 0xa9b3},   {0xa9b6, 0xa9b9},
+      {0xa9bc, 0xa9bd},   {0xa9e5, 0xa9e5},   {0xaa29, 0xaa2e},
+      {0xaa31, 0xaa32},   {0xaa35, 0xaa36},   {0xaa43, 0xaa43},
+      {0xaa4c, 0xaa4c},   {0xaa7c, 0xaa7c},   {0xaab0, 0xaab0},
+      {0xaab2, 0xaab4},   {0xaab7, 0xaab8},   {0xaabe, 0xaabf},
+      {0xaac1, 0xaac1},   {0xaaec, 0xaaed},   {0xaaf6, 0xaaf6},
+      {0xabe5, 0xabe5},   {0xabe8, 0xabe8},   {0xabed, 0xabed},
+      {0xd7b0, 0xd7ff},   {0xfb1e, 0xfb1e},   {0xfe00, 0xfe0f},
+      {0xfe20, 0xfe2f},   {0xfeff, 0xfeff},   {0xfff9, 0xfffb},
+      {0x101fd, 0x101fd}, {0x102e0, 0x102e0}, {0x10376, 0x1037a},
+      {0x10a01, 0x10a03}, {0x10a05, 0x10a06}, {0x10a0c, 0x10a0f},
+      {0x10a38, 0x10a3a}, {0x10a3f, 0x10a3f}, {0x10ae5, 0x10ae6},
+      {0x10d24, 0x10d27}, {0x10eab, 0x10eac}, {0x10f46, 0x10f50},
+      {0x11001, 0x11001}, {0x11038, 0x11046}, {0x1107f, 0x11081},
+      {0x110b3, 0x110b6}, {0x110b9, 0x110ba}, {0x11100, 0x11102},
+      {0x11127, 0x1112b}, {0x1112d, 0x11134}, {0x11173, 0x11173},
+      {0x11180, 0x11181}, {0x111b6, 0x111be}, {0x1122f, 0x11231},
+      {0x11234, 0x11234}, {0x11236, 0x11237}, {0x112df, 0x112df},
+      {0x112e3, 0x112ea}, {0x11300, 0x11301}, {0x1133b, 0x1133c},
+      {0x11340, 0x11340}, {0x11366, 0x1136c}, {0x11370, 0x11374},
+      {0x11438, 0x1143f}, {0x11442, 0x11444}, {0x11446, 0x11446},
+      {0x114b3, 0x114b8}, {0x114ba, 0x114ba}, {0x114bf, 0x114c0},
+      {0x114c2, 0x114c3}, {0x115b2, 0x115b5}, {0x115bc, 0x115bd},
+      {0x115bf, 0x115c0}, {0x11633, 0x1163a}, {0x1163d, 0x1163d},
+      {0x1163f, 0x11640}, {0x116ab, 0x116ab}, {0x116ad, 0x116ad},
+      {0x116b0, 0x116b5}, {0x116b7, 0x116b7}, {0x1171d, 0x1171f},
+      {0x11722, 0x11725}, {0x11727, 0x1172b}, {0x16af0, 0x16af4},
+      {0x16b30, 0x16b36}, {0x16f4f, 0x16f4f}, {0x16f8f, 0x16f92},
+      {0x16fe4, 0x16fe4}, {0x1bc9d, 0x1bc9e}, {0x1bca0, 0x1bca3},
+      {0x1cf00, 0x1cf2d}, {0x1cf30, 0x1cf46}, {0x1d167, 0x1d169},
+      {0x1d173, 0x1d182}, {0x1d185, 0x1d18b}, {0x1d1aa, 0x1d1ad},
+      {0x1d242, 0x1d244}, {0x1da00, 0x1da36}, {0x1da3b, 0x1da6c},
+      {0x1da75, 0x1da75}, {0x1da84, 0x1da84}, {0x1da9b, 0x1da9f},
+      {0x1daa1, 0x1daaf}, {0x1e000, 0x1e006}, {0x1e008, 0x1e018},
+      {0x1e01b, 0x1e021}, {0x1e023, 0x1e024}, {0x1e026, 0x1e02a},
+      {0x1e130, 0x1e136}, {0x1e2ec, 0x1e2ef}, {0x1e8d0, 0x1e8d6},
+      {0x1e944, 0x1e94a}, {0xe0001, 0xe0001}, {0xe0020, 0xe007f},
+      {0xe0100, 0xe01ef}};
+  static constexpr Range Wide[] = {
+      {0x1100, 0x115f},   {0x231a, 0x231b},   {0x2329, 0x232a},
+      {0x23e9, 0x23ec},   {0x23f0, 0x23f0},   {0x23f3, 0x23f3},
+      {0x25fd, 0x25fe},   {0x2614, 0x2615},   {0x2648, 0x2653},
+      {0x267f, 0x267f},   {0x2693, 0x2693},   {0x26a1, 0x26a1},
+      {0x26aa, 0x26ab},   {0x26bd, 0x26be},   {0x26c4, 0x26c5},
+      {0x26ce, 0x26ce},   {0x26d4, 0x26d4},   {0x26ea, 0x26ea},
+      {0x26f2, 0x26f3},   {0x26f5, 0x26f5},   {0x26fa, 0x26fa},
+      {0x26fd, 0x26fd},   {0x2705, 0x2705},   {0x270a, 0x270b},
+      {0x2728, 0x2728},   {0x274c, 0x274c},   {0x274e, 0x274e},
+      {0x2753, 0x2755},   {0x2757, 0x2757},   {0x2795, 0x2797},
+      {0x27b0, 0x27b0},   {0x27bf, 0x27bf},   {0x2b1b, 0x2b1c},
+      {0x2b50, 0x2b50},   {0x2b55, 0x2b55},   {0x2e80, 0x303e},
+      {0x3041, 0x33ff},   {0x3400, 0x4dbf},   {0x4e00, 0x9fff},
+      {0xa000, 0xa4cf},   {0xa960, 0xa97f},   {0xac00, 0xd7a3},
+      {0xf900, 0xfaff},   {0xfe10, 0xfe19},   {0xfe30, 0xfe6f},
+      {0xff00, 0xff60},   {0xffe0, 0xffe6},   {0x16fe0, 0x16fe4},
+      {0x16ff0, 0x16ff1}, {0x17000, 0x18cd5}, {0x18d00, 0x18d08},
+      {0x1aff0, 0x1b2ff}, {0x1f004, 0x1f004}, {0x1f0cf, 0x1f0cf},
+      {0x1f18e, 0x1f18e}, {0x1f191, 0x1f19a}, {0x1f200, 0x1f202},
+      {0x1f210, 0x1f23b}, {0x1f240, 0x1f248}, {0x1f250, 0x1f251},
+      {0x1f260, 0x1f265}, {0x1f300, 0x1f320}, {0x1f32d, 0x1f335},
+      {0x1f337, 0x1f37c}, {0x1f37e, 0x1f393}, {0x1f3a0, 0x1f3ca},
+      {0x1f3cf, 0x1f3d3}, {0x1f3e0, 0x1f3f0}, {0x1f3f4, 0x1f3f4},
+      {0x1f3f8, 0x1f43e}, {0x1f440, 0x1f440}, {0x1f442, 0x1f4fc},
+      {0x1f4ff, 0x1f53d}, {0x1f54b, 0x1f54e}, {0x1f550, 0x1f567},
+      {0x1f57a, 0x1f57a}, {0x1f595, 0x1f596}, {0x1f5a4, 0x1f5a4},
+      {0x1f5fb, 0x1f64f}, {0x1f680, 0x1f6c5}, {0x1f6cc, 0x1f6cc},
+      {0x1f6d0, 0x1f6d2}, {0x1f6d5, 0x1f6d7}, {0x1f6dc, 0x1f6df},
+      {0x1f6eb, 0x1f6ec}, {0x1f6f4, 0x1f6fc}, {0x1f7e0, 0x1f7eb},
+      {0x1f7f0, 0x1f7f0}, {0x1f90c, 0x1f93a}, {0x1f93c, 0x1f945},
+      {0x1f947, 0x1f9ff}, {0x1fa70, 0x1faff}, {0x20000, 0x2fffd},
+      {0x30000, 0x3fffd}};
+
+  template <size_t N>
+  static constexpr auto Sorted(const Range (&list)[N]) -> bool {
+    for (size_t i = 0; i < N; i++) {
+      if (list[i].First > list[i].Last ||
+          (i > 0 && list[i].First <= list[i - 1].Last)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  // Returns the first range of 'list' that ends at or after 'c', or N.
+  template <size_t N>
+  static constexpr auto Find(const Range (&list)[N], uint32_t c) -> size_t {
+    size_t lo = 0;
+    size_t hi = N;
+    while (lo < hi) {
+      size_t const mid = (lo + hi) / 2;
+      if (list[mid].Last < c) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return lo;
+  }
+  // Returns 0 if no range of 'list' meets [first, last], 2 if one covers it
+  // and 1 otherwise.
+  template <size_t N>
+  static constexpr auto Cover(const Range (&list)[N], uint32_t first,
+                              uint32_t last) -> int {
+    size_t const i = Find(list, first);
+    if (i == N || list[i].First > last) {
+      return 0;
+    }
+    return (list[i].First <= first && list[i].Last >= last) ? 2 : 1;
+  }
+  // Returns the width of one code point from the lists themselves.
+  static constexpr auto Of(uint32_t c) -> int {
+    return (Cover(Zero, c, c) != 0) ? 0 : (Cover(Wide, c, c) != 0) ? 2 : 1;
+  }
+  // Returns the width shared by the 256 code points of block 'b', or -1 if
+  // they differ.
+  static constexpr auto Uniform(uint32_t b) -> int {
+    uint32_t const first = b << 8;
+    uint32_t const last = first | 0xff;
+    int const zero = Cover(Zero, first, last);
+    if (zero != 0) {
+      return (zero == 2) ? 0 : -1;
+    }
+    int const wide = Cover(Wide, first, last);
+    return (wide == 0) ? 1 : (wide == 2) ? 2 : -1;
+  }
+  // Returns the number of blocks whose code points differ in width.
+  static constexpr auto Mixed() -> size_t {
+    size_t count = 0;
+    for (uint32_t b = 0; b < (0x110000 >> 8); b++) {
+      count += (Uniform(b) < 0) ? 1 : 0;
+    }
+    return count;
+  }
+};
+/* UTF-8 decoding and cell widths for terminal output. The decoder streams,
+so a sequence split across two reads still comes out whole, and it replaces
+each malformed sequence with U+FFFD after Unicode's maximal subpart rule. The
+scans that find runs of plain ASCII go sixteen bytes at a time with SSE2, so
+output that is mostly ASCII never reaches the decoder. Widths come from a
+two-level table built at compile time from WidthRanges: the high bits of a
+code point pick a block of 256, and blocks whose code points all share a
+width point at one of three shared blocks, so only the few mixed blocks are
+stored, two bits per code point. */
+struct Utf8 {
+private:
+  static constexpr size_t BlockCount = 0x110000 >> 8;
+  static constexpr size_t MixedCount = WidthRanges::Mixed();
+  static_assert(WidthRanges::Sorted(WidthRanges::Zero) &&
+                    WidthRanges::Sorted(WidthRanges::Wide),
+                "width ranges out of order");
+  static_assert(MixedCount + 3 <= 256, "block index must fit a byte");
+  struct Tables {
+    uint8_t Index[BlockCount];
+    uint8_t Blocks[MixedCount + 3][64];
+  };
+  static constexpr auto Build() -> Tables {
+    Tables t{};
+    for (int w = 0; w < 3; w++) {
+      for (auto &packed : t.Blocks[w]) {
+        packed = static_cast<uint8_t>(w * 0x55);
+      }
+    }
+    size_t next = 3;
+    for (uint32_t b = 0; b < BlockCount; b++) {
+      int const w = WidthRanges::Uniform(b);
+      if (w >= 0) {
+        t.Index[b] = static_cast<uint8_t>(w);
+        continue;
+      }
+      t.Index[b] = static_cast<uint8_t>(next);
+      for (uint32_t c = 0; c < 256; c++) {
+        t.Blocks[next][c >> 2] = static_cast<uint8_t>(
+            t.Blocks[next][c >> 2] |
+            WidthRanges::Of(b << 8 | c) << ((c & 3) * 2));
+      }
+      next++;
+    }
+    return t;
+  }
+  static const Tables Table;
+
+  /* The sequence being decoded: its bits so far, the continuation bytes it
+  still needs, and the range the next one must fall in. */
+  uint32_t Code{0};
+  int Need{0};
+  unsigned char Low{0x80};
+  unsigned char High{0xbf};
+
+  // Starts a sequence at lead byte 'c'. Returns false if 'c' cannot start
+  // one.
+  auto Lead(unsigned char c) -> bool {
+    Low = 0x80;
+    High = 0xbf;
+    if (c >= 0xc2 && c <= 0xdf) {
+      Need = 1;
+      Code = c & 0x1fu;
+    } else if (c >= 0xe0 && c <= 0xef) {
+      Need = 2;
+      Code = c & 0x0fu;
+      Low = (c == 0xe0) ? 0xa0 : 0x80;
+      High = (c == 0xed) ? 0x9f : 0xbf;
+    } else if (c >= 0xf0 && c <= 0xf4) {
+      Need = 3;
+      Code = c & 0x07u;
+      Low = (c == 0xf0) ? 0x90 : 0x80;
+      High = (c == 0xf4) ? 0x8f : 0xbf;
+    } else {
+      return false;
+    }
+    return true;
+  }
+  // Adds continuation byte 'c'. Returns false if it does not belong.
+  auto Trail(unsigned char c) -> bool {
+    if (c < Low || c > High) {
+      return false;
+    }
+    Code = Code << 6 | (c & 0x3fu);
+    Low = 0x80;
+    High = 0xbf;
+    Need--;
+    return true;
+  }
+
+public:
+  static constexpr uint32_t Replacement = 0xfffd;
+
+  // Returns the number of cells code point 'c' takes: 0 for combining marks
+  // and format characters, 2 for wide ones and 1 for the rest.
+  static auto Width(uint32_t c) -> int {
+    if (c >= 0x110000) {
+      return 1;
+    }
+    return (Table.Blocks[Table.Index[c >> 8]][(c & 0xff) >> 2] >>
+            ((c & 3) * 2)) &
+           3;
+  }
+  // Returns the length of the run of ASCII bytes at the start of 'src'.
+  static auto Ascii(const char *src, size_t len) -> size_t {
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= len; i += 16) {
+      int const mask = _mm_movemask_epi8(
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)));
+      if (mask != 0) {
+        return i + static_cast<size_t>(__builtin_ctz(mask));
+      }
+    }
+#endif
+    while (i < len && static_cast<unsigned char>(src[i]) < 0x80) {
+      i++;
+    }
+    return i;
+  }
+  // Returns the length of the run of ASCII bytes other than NUL and carriage
+  // return at the start of 'src'.
+  static auto Plain(const char *src, size_t len) -> size_t {
+    size_t i = 0;
+#if defined(__SSE2__)
+    __m128i const one = _mm_set1_epi8(1);
+    __m128i const cr = _mm_set1_epi8('\r');
+    for (; i + 16 <= len; i += 16) {
+      __m128i const v =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+      // Signed compare: NUL and every byte from 0x80 up are below one.
+      int const mask = _mm_movemask_epi8(
+          _mm_or_si128(_mm_cmplt_epi8(v, one), _mm_cmpeq_epi8(v, cr)));
+      if (mask != 0) {
+        return i + static_cast<size_t>(__builtin_ctz(mask));
+      }
+    }
+#endif
+    for (; i < len; i++) {
+      unsigned char const c = static_cast<unsigned char>(src[i]);
+      if (c == '\0' || c == '\r' || c >= 0x80) {
+        break;
+      }
+    }
+    return i;
+  }
+  // Returns true while a sequence is unfinished.
+  auto Pending() const -> bool { return Need > 0; }
+  // Drops an unfinished sequence. Returns true if there was one, which the
+  // caller shows as U+FFFD.
+  auto Reset() -> bool {
+    bool const pending = Need > 0;
+    Need = 0;
+    return pending;
+  }
+  // Decodes 'src', calling 'emit' with each code point completed. A
+  // sequence left unfinished at the end is carried into the next call.
+  template <typename Emit>
+  auto Decode(const char *src, size_t len, Emit &&emit) -> void {
+    for (size_t i = 0; i < len; i++) {
+      unsigned char const c = static_cast<unsigned char>(src[i]);
+      if (Need > 0) {
+        if (Trail(c)) {
+          if (Need == 0) {
+            emit(Code);
+          }
+          continue;
+        }
+        Need = 0;
+        emit(Replacement);
+      }
+      if (c < 0x80) {
+        emit(static_cast<uint32_t>(c));
+      } else if (!Lead(c)) {
+        emit(Replacement);
+      }
+    }
+  }
+  // Decodes the code point at 'i' of 'text' and moves 'i' past it. A
+  // malformed sequence gives U+FFFD.
+  static auto Next(std::string_view text, size_t &i) -> uint32_t {
+    unsigned char const c = static_cast<unsigned char>(text[i++]);
+    if (c < 0x80) {
+      return c;
+    }
+    Utf8 seq;
+    if (!seq.Lead(c)) {
+      return Replacement;
+    }
+    while (seq.Need > 0) {
+      if (i >= text.size() ||
+          !seq.Trail(static_cast<unsigned char>(text[i]))) {
+        return Replacement;
+      }
+      i++;
+    }
+    return seq.Code;
+  }
+  static auto Encode(uint32_t c, std::string &out) -> void {
+    if (c < 0x80) {
+      out += static_cast<char>(c);
+    } else if (c < 0x800) {
+      out += static_cast<char>(0xc0 | (c >> 6));
+      out += static_cast<char>(0x80 | (c & 0x3f));
+    } else if (c < 0x10000) {
+      out += static_cast<char>(0xe0 | (c >> 12));
+      out += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+      out += static_cast<char>(0x80 | (c & 0x3f));
+    } else {
+      out += static_cast<char>(0xf0 | (c >> 18));
+      out += static_cast<char>(0x80 | ((c >> 12) & 0x3f));
+      out += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+      out += static_cast<char>(0x80 | (c & 0x3f));
+    }
+  }
+  // Copies 'text' to 'out' without NUL bytes and carriage returns, replacing
+  // malformed sequences with U+FFFD. Plain ASCII is copied a run at a time.
+  static auto Clean(std::string_view text, std::string &out) -> void {
+    out.clear();
+    out.reserve(text.size());
+    size_t i = 0;
+    while (i < text.size()) {
+      size_t const run = Plain(text.data() + i, text.size() - i);
+      out.append(text, i, run);
+      i += run;
+      if (i >= text.size()) {
+        break;
+      }
+      if (text[i] == '\0' || text[i] == '\r') {
+        i++;
+      } else {
+        Encode(Next(text, i), out);
+      }
+    }
+  }
+};
+/* Built at compile time; defined here since the class must be complete. */
+inline constexpr Utf8::Tables Utf8::Table = Utf8::Build();
+} // namespace Origin
+#endif // UTF8_HPP
@@ -2,11 +2,37 @@
 #define MAIN_CPP
 #include "main.hpp"
 #include "include/app.hpp"
+#include "include/batch.hpp"
+#include "include/profile.hpp"
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
 namespace Origin {
 auto main(int argc, char *argv[]) -> int {
+  // '--startup-profile' times each phase up to the first frame and reports
+  // it into the scrollback; '--startup-profile=file' writes it as JSON.
+  std::string profile;
+  if (argc > 1 && strncmp(argv[1], "--startup-profile", 17) == 0 &&
+      (argv[1][17] == '\0' || argv[1][17] == '=')) {
+    Startup::Begin();
+    profile = argv[1] + ((argv[1][17] == '=') ? 18 : 17);
+    argv[1] = argv[0];
+    argc--;
+    argv++;
+  }
+  // Arguments or a stdin that is not a terminal mean a script: it runs
+  // without the terminal front end.
+  if (argc > 1 || isatty(STDIN_FILENO) == 0) {
+    return Batch::Main(argc, argv, profile);
+  }
   App app = App(argc, argv);
-  return (app.loop(seconds(100)));
+  app.SetStartupFile(profile);
+  // $TSHELL_RUNTIME overrides the run limit in seconds; 0 leaves it unbounded.
+  const char *limit = getenv("TSHELL_RUNTIME");
+  return (app.loop((limit != nullptr && *limit != '\0') ? seconds(atol(limit))
+                                                         : seconds(100)));
 }
 } // namespace Origin
 int main(int argc, char *argv[]) { return Origin::main(argc, argv); }
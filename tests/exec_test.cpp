@@ -0,0 +1,139 @@
+#include "builtin.hpp"
+#include "exec.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+namespace Origin {
+/* Runs lines with redirections through the executor and checks the status
+and what the shell reported for each, for spawned commands and for built-ins
+run in the shell. Returns the number of failed checks. */
+struct ExecTest {
+private:
+  Exec Proc;
+  Builtins Cmds;
+  std::string Text;
+  /* What built-ins printed that was not redirected. */
+  std::string Printed;
+  std::string Dir;
+  int Failed{0};
+
+  static auto Read(const std::string &path) -> std::string {
+    std::ifstream file(path);
+    std::stringstream text;
+    text << file.rdbuf();
+    return text.str();
+  }
+
+  auto Check(bool ok, const std::string &what) -> void {
+    if (!ok) {
+      std::fprintf(stderr, "FAIL: %s\n", what.c_str());
+      Failed++;
+    }
+  }
+  // Runs a line to its end. Returns the status of its last pipeline and
+  // leaves its output in Text.
+  auto Run(const std::string &line) -> int {
+    Proc.Run(line);
+    while (Proc.IsRunning()) {
+      Proc.Poll(10);
+    }
+    Proc.GetText().Tail(Text, SIZE_MAX);
+    return Proc.GetLast();
+  }
+
+public:
+  ExecTest() {
+    char dir[] = "/tmp/tshell_exec_test.XXXXXX";
+    Dir = (mkdtemp(dir) != nullptr) ? dir : "/tmp";
+    // 'say out err' prints its arguments to stdout and stderr.
+    Cmds.Register("say", [this](const Builtins::Args &args) {
+      Cmds.Print(1, args[1] + "\n");
+      Cmds.Print(2, args[2] + "\n");
+      return 0;
+    });
+    Cmds.Register("cd", [](const Builtins::Args &args) {
+      return (chdir(args[1].c_str()) == 0) ? 0 : 1;
+    });
+    Cmds.SetWriter([this](int fd, std::string_view text) {
+      Printed += std::to_string(fd) + ":";
+      Printed.append(text);
+    });
+    Proc.SetBuiltins(&Cmds);
+  }
+  ~ExecTest() {
+    std::string const rm = "rm -rf " + Dir;
+    (void)system(rm.c_str());
+  }
+  ExecTest(const ExecTest &) = delete;
+  auto operator=(const ExecTest &) -> ExecTest & = delete;
+  // A built-in's output follows its redirections, which are undone after it.
+  auto BuiltinRedirects() -> void {
+    Run("say out err > " + Dir + "/1");
+    Check(Read(Dir + "/1") == "out\n", "'>' sends a built-in's stdout");
+    Check(Printed == "2:err\n", "'>' leaves a built-in's stderr alone");
+    Printed.clear();
+    Run("say out err 2>" + Dir + "/2");
+    Check(Read(Dir + "/2") == "err\n", "'2>' sends a built-in's stderr");
+    Check(Printed == "1:out\n", "'2>' leaves a built-in's stdout alone");
+    Printed.clear();
+    Run("say out err >" + Dir + "/3 2>&1");
+    Check(Read(Dir + "/3") == "out\nerr\n", "'2>&1' follows '>'");
+    Run("say out err 2>&1 >>" + Dir + "/3");
+    Check(Read(Dir + "/3") == "out\nerr\nout\n", "'>>' appends");
+    Check(Printed == "1:err\n", "'2>&1' before '>' keeps the old stdout");
+    Printed.clear();
+    Run("say out err");
+    Check(Printed == "1:out\n2:err\n", "redirections are undone");
+    Check(Run("cd / > " + Dir + "/4") == 0, "cd with a redirection runs");
+    struct stat st {};
+    Check(stat((Dir + "/4").c_str(), &st) == 0, "cd creates its target");
+    Check(Run("> " + Dir + "/5") == 0 && stat((Dir + "/5").c_str(), &st) == 0,
+          "a lone redirection creates its target");
+    Check(Run("say out err > " + Dir + "/none/6") == 1,
+          "a built-in's failed redirection exits with status 1");
+  }
+  // A target that cannot be opened is reported as such, with status 1.
+  auto BadTarget() -> void {
+    int const status = Run("echo hi > /nonexistent/dir/f");
+    Check(status == 1, "a failed redirection exits with status 1");
+    Check(Text.find("/nonexistent/dir/f: No such file or directory") !=
+              std::string::npos,
+          "a failed redirection names the file");
+    Check(Text.find("command not found") == std::string::npos,
+          "a failed redirection is not reported as a missing command");
+    Check(Run("no-such-command-here") == 127 &&
+              Text.find("command not found") != std::string::npos,
+          "a missing command is still reported as not found");
+    Check(Run("echo hi >&9") == 1, "copying a closed descriptor fails");
+  }
+  // An assignment sets a shell variable that commands do not inherit until
+  // it is exported; one already exported stays so.
+  auto Exported() -> void {
+    Environment &env = Environment::Shell();
+    Run("TSHELL_TEST_A=1; sh -c 'echo \"[$TSHELL_TEST_A]\"'");
+    Check(Text.find("[]") != std::string::npos,
+          "an assignment is not passed to commands");
+    Check(Run("echo $TSHELL_TEST_A") == 0 && Text.find("1") == 0,
+          "an assignment is seen by the shell");
+    env.Export("TSHELL_TEST_A");
+    Run("TSHELL_TEST_A=2; sh -c 'echo \"[$TSHELL_TEST_A]\"'");
+    Check(Text.find("[2]") != std::string::npos,
+          "an exported variable stays exported when set again");
+    Check(getenv("TSHELL_TEST_A") != nullptr, "exports reach environ");
+    env.Unset("TSHELL_TEST_A");
+  }
+  auto Run() -> int {
+    BadTarget();
+    BuiltinRedirects();
+    Exported();
+    return Failed;
+  }
+};
+} // namespace Origin
+int main() {
+  Origin::ExecTest test;
+  return (test.Run() == 0) ? 0 : 1;
+}
@@ -0,0 +1,70 @@
+#include "builtin.hpp"
+#include "jobs.hpp"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+namespace Origin {
+/* Runs 'fg' and 'wait' against a background job that has already finished.
+Each runs as a foreground line of one built-in, whose executor is still on
+the stack while the built-in runs, so the job table must not be collected
+from inside it. Built with AddressSanitizer, a job freed too early shows up
+as a use after free. Returns the number of failed checks. */
+struct JobsTest {
+private:
+  Builtins Cmds;
+  Jobs Procs;
+  int Failed{0};
+
+  auto Check(bool ok, const std::string &what) -> void {
+    if (!ok) {
+      std::fprintf(stderr, "FAIL: %s\n", what.c_str());
+      Failed++;
+    }
+  }
+  // Polls the jobs until the shell is idle again, or gives up after a few
+  // seconds.
+  auto Settle() -> bool {
+    for (int i = 0; i < 500 && (Procs.IsBusy() || Procs.Background() > 0);
+         i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      Procs.Poll(true);
+    }
+    return !Procs.IsBusy() && Procs.Background() == 0;
+  }
+  // Starts a short background job and lets it exit without reaping it, then
+  // runs 'line' while the job is still in the table.
+  auto AfterFinished(const std::string &line) -> void {
+    size_t const finished = Procs.GetFinished();
+    Check(Procs.Run("sleep 0.05 &") == 0, "start a background job");
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    Check(Procs.Run(line) == 0, "run '" + line + "'");
+    Check(Settle(), "'" + line + "' leaves the shell idle");
+    Check(Procs.GetLast() == 0, "'" + line + "' exits with status 0");
+    // The line starting the job, the job and the line running the built-in.
+    Check(Procs.GetFinished() == finished + 3,
+          "'" + line + "' finishes every job once");
+  }
+
+public:
+  JobsTest() {
+    Cmds.Register("fg", [this](const Builtins::Args &args) {
+      return Procs.Fg((args.size() > 1) ? atoi(args[1].c_str()) : 0) != 0;
+    });
+    Cmds.Register("wait", [this](const Builtins::Args &args) {
+      return Procs.Wait((args.size() > 1) ? atoi(args[1].c_str()) : 0) != 0;
+    });
+    Procs.SetBuiltins(&Cmds);
+  }
+  auto Run() -> int {
+    AfterFinished("fg");
+    AfterFinished("wait");
+    AfterFinished("wait 1");
+    return Failed;
+  }
+};
+} // namespace Origin
+int main() {
+  Origin::JobsTest test;
+  return (test.Run() == 0) ? 0 : 1;
+}
@@ -0,0 +1,60 @@
+#include "scrollback.hpp"
+#include "terminal.hpp"
+#include <cstdio>
+#include <string>
+#include <vector>
+namespace Origin {
+/* Resizes the terminal while a program is on the alternate screen, as a
+window resize under vim, less or top does, and checks that the program stays
+on it and that the shell's output on the main screen survives. Returns the
+number of failed checks. */
+struct TerminalTest {
+private:
+  Scrollback Log;
+  Terminal Term;
+  std::vector<Cell> Cells;
+  int Failed{0};
+
+  auto Check(bool ok, const std::string &what) -> void {
+    if (!ok) {
+      std::fprintf(stderr, "FAIL: %s\n", what.c_str());
+      Failed++;
+    }
+  }
+  // Returns row y as text, without trailing blanks.
+  auto Row(int y) -> std::string {
+    Term.CopyRows(y, 1, Cells);
+    std::string text;
+    for (auto const &cell : Cells) {
+      text += static_cast<char>(cell.Code);
+    }
+    return text.substr(0, text.find_last_not_of(' ') + 1);
+  }
+
+public:
+  TerminalTest() { Term.SetScrollback(&Log); }
+  auto Run() -> int {
+    Term.Resize(20, 5);
+    Term.Append("one\r\ntwo\r\n");
+    Term.Append("\033[?1049h\033[Hfull");
+    size_t const saved = Log.LineCount();
+    Term.Resize(30, 3);
+    Check(Row(0) == "full", "a resize keeps the alternate screen");
+    Term.Append("\033[3;1H\n\n\nend");
+    Check(Log.LineCount() == saved,
+          "scrolling the alternate screen saves nothing");
+    Term.Append("\033[?1049l");
+    Check(Row(0) == "one" && Row(1) == "two",
+          "leaving the alternate screen restores the main one");
+    Check(Term.GetWidth() == 30 && Term.GetHeight() == 3,
+          "the main screen has the new size");
+    Term.Append("x");
+    Check(Row(2) == "x", "the main cursor is kept");
+    return Failed;
+  }
+};
+} // namespace Origin
+int main() {
+  Origin::TerminalTest test;
+  return (test.Run() == 0) ? 0 : 1;
+}